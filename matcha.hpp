@@ -0,0 +1,5313 @@
+// matcha: expressive matchers for C++ tests.
+//
+// Usage:
+// Include this header and write expect(actual, to(equal(expected))).
+
+#ifndef H_MATCHA
+#define H_MATCHA
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <array>
+#include <map>
+#include <forward_list>
+#include <initializer_list>
+#include <type_traits>
+#include <algorithm>
+#include <iterator>
+#include <valarray>
+#include <typeinfo>
+#include <bitset>
+#include <stdexcept>
+#include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <new>
+#include <cmath>
+#include <limits>
+#include <functional>
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MATCHA_SIMD_X86 1
+#include <immintrin.h>
+#endif
+#if __cplusplus > 201703L && __has_include(<ranges>)
+#include <ranges>
+#endif
+#if defined(MATCHA_STATS)
+#include <cstdlib>
+#include <fstream>
+#include <typeindex>
+#include <unordered_map>
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#define MATCHA_STATS_DEMANGLE 1
+#endif
+#endif
+#include "prettyprint.hpp"
+
+namespace matcha {
+
+  using pretty_print::writer;
+  using pretty_print::print_limits;
+
+  // Predicates are instantiated on the unqualified argument types. Unlike
+  // std::decay, arrays keep their type so predicates can see their extent.
+  template<class T>
+  using predicate_arg_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+  // Per-matcher evaluation statistics, compiled in by MATCHA_STATS. Every
+  // Matcher::matches call is counted and timed, inclusive of the matchers
+  // it wraps, under its predicate type and the expect() call site.
+  // Threads fill their own tables, which are merged into a process-wide
+  // one when the thread exits; the merged table is written as JSON at exit
+  // to the file $MATCHA_STATS_JSON names, if it is set.
+  namespace stats {
+
+#if defined(MATCHA_STATS)
+    struct site
+    {
+      const char * file;
+      unsigned line;
+
+      static constexpr site current(const char * file = __builtin_FILE(),
+          unsigned line = __builtin_LINE()) {
+        return site { file, line };
+      }
+    };
+
+    inline site & current_site() {
+      static thread_local site s { "", 0 };
+      return s;
+    }
+
+    // Attributes the matches calls made during its lifetime to where.
+    class site_scope
+    {
+    public:
+      explicit site_scope(site where) : saved_(current_site()) {
+        current_site() = where;
+      }
+      ~site_scope() { current_site() = saved_; }
+
+    private:
+      site saved_;
+    };
+
+    // Durations are bucketed log-linearly, four buckets per power of two,
+    // so a percentile interpolated within its bucket is off by at most a
+    // quarter of the value.
+    struct entry
+    {
+      static constexpr int nbuckets = 4 + 62 * 4;
+
+      std::uint64_t calls = 0;
+      std::uint64_t failures = 0;
+      std::uint64_t total_ns = 0;
+      std::uint64_t min_ns = ~std::uint64_t(0);
+      std::uint64_t max_ns = 0;
+      std::uint64_t buckets[nbuckets] = {};
+
+      static int bucket(std::uint64_t ns) {
+        if (ns < 4)
+          return static_cast<int>(ns);
+        const int e = 63 - __builtin_clzll(ns);
+        return 4 + (e - 2) * 4 + static_cast<int>((ns >> (e - 2)) & 3);
+      }
+
+      static double lower_bound(int b) {
+        if (b < 4)
+          return b;
+        const int e = (b - 4) / 4 + 2;
+        return std::ldexp(1.0 + ((b - 4) % 4) / 4.0, e);
+      }
+
+      void add(std::uint64_t ns, bool matched) {
+        ++calls;
+        failures += !matched;
+        total_ns += ns;
+        min_ns = std::min(min_ns, ns);
+        max_ns = std::max(max_ns, ns);
+        ++buckets[bucket(ns)];
+      }
+
+      void merge(const entry & other) {
+        calls += other.calls;
+        failures += other.failures;
+        total_ns += other.total_ns;
+        min_ns = std::min(min_ns, other.min_ns);
+        max_ns = std::max(max_ns, other.max_ns);
+        for (int b = 0; b < nbuckets; ++b)
+          buckets[b] += other.buckets[b];
+      }
+
+      double percentile(double p) const {
+        const double rank = p * static_cast<double>(calls);
+        double seen = 0;
+
+        for (int b = 0; b < nbuckets; ++b) {
+          if (buckets[b] == 0 || seen + buckets[b] < rank) {
+            seen += buckets[b];
+            continue;
+          }
+          const double lo = std::max(lower_bound(b), double(min_ns));
+          const double hi = std::min(lower_bound(b + 1), double(max_ns));
+          return lo + (hi - lo) * (rank - seen) / buckets[b];
+        }
+        return double(max_ns);
+      }
+    };
+
+    class registry
+    {
+    public:
+      // Call sites are compared by file name here, as the same header
+      // seen from two translation units may give two pointers.
+      struct key
+      {
+        std::type_index predicate;
+        std::string file;
+        unsigned line;
+
+        bool operator<(const key & other) const {
+          return std::tie(file, line, predicate) <
+            std::tie(other.file, other.line, other.predicate);
+        }
+      };
+
+      static registry & instance() {
+        static registry r;
+        return r;
+      }
+
+      ~registry() {
+        const char * path = std::getenv("MATCHA_STATS_JSON");
+        if (path == nullptr || *path == '\0')
+          return;
+
+        std::ofstream out(path);
+        if (out)
+          write_json(out);
+      }
+
+      void merge(const key & k, const entry & e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[k].merge(e);
+      }
+
+      void write_json(std::ostream & stream);
+
+    private:
+      registry() = default;
+
+      std::mutex mutex_;
+      std::map<key, entry> entries_;
+    };
+
+    class thread_table
+    {
+    public:
+      // Touching the registry first makes it outlive every table.
+      thread_table() { registry::instance(); }
+      ~thread_table() { flush(); }
+
+      void record(const std::type_info & predicate, std::uint64_t ns, 
+          bool matched)
+      {
+        const site & where = current_site();
+        const local_key k { &predicate, where.file, where.line };
+
+        if (last_ == nullptr || !(last_key_ == k)) {
+          last_ = &entries_[k];
+          last_key_ = k;
+        }
+        last_->add(ns, matched);
+      }
+
+      void flush() {
+        registry & r = registry::instance();
+        for (const auto & e : entries_)
+          r.merge(registry::key { *e.first.predicate, e.first.file,
+            e.first.line }, e.second);
+        entries_.clear();
+        last_ = nullptr;
+      }
+
+    private:
+      struct local_key
+      {
+        const std::type_info * predicate;
+        const char * file;
+        unsigned line;
+
+        bool operator==(const local_key & other) const {
+          return *predicate == *other.predicate && file == other.file &&
+            line == other.line;
+        }
+      };
+
+      struct local_hash
+      {
+        std::size_t operator()(const local_key & k) const {
+          return k.predicate->hash_code() ^ 
+            (std::hash<const char *>()(k.file) * 31 + k.line);
+        }
+      };
+
+      std::unordered_map<local_key, entry, local_hash> entries_;
+      local_key last_key_ {};
+      entry * last_ = nullptr;
+    };
+
+    inline thread_table & local() {
+      static thread_local thread_table table;
+      return table;
+    }
+
+    typedef std::chrono::steady_clock clock;
+
+    inline void record(const std::type_info & predicate, 
+        clock::time_point start, bool matched)
+    {
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock::now() - start).count();
+      local().record(predicate, static_cast<std::uint64_t>(ns), matched);
+    }
+
+    // Writes the statistics merged so far, including the calling thread's
+    // own; other threads still running are not included.
+    inline void write_json(std::ostream & out) {
+      local().flush();
+      registry::instance().write_json(out);
+    }
+
+    namespace detail {
+
+      inline void write_json_string(writer & w, const char * s) {
+        w << '"';
+        for (; *s; ++s) {
+          const unsigned char c = static_cast<unsigned char>(*s);
+          if (c == '"' || c == '\\') {
+            w << '\\' << *s;
+          } else if (c < 0x20) {
+            const char hex[] = "0123456789abcdef";
+            w << "\\u00" << hex[c >> 4] << hex[c & 15];
+          } else {
+            w << *s;
+          }
+        }
+        w << '"';
+      }
+
+      inline std::string demangle(const char * name) {
+#if defined(MATCHA_STATS_DEMANGLE)
+        int status = 0;
+        char * readable = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (status == 0 && readable) {
+          std::string result(readable);
+          std::free(readable);
+          return result;
+        }
+#endif
+        return name;
+      }
+
+    }; // end detail
+
+    inline void registry::write_json(std::ostream & stream)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      writer w(stream);
+      const char * delim = "\n  ";
+
+      w << "{\"matchers\": [";
+      for (const auto & e : entries_) {
+        const entry & s = e.second;
+        w << delim << "{\"predicate\": ";
+        detail::write_json_string(w, 
+          detail::demangle(e.first.predicate.name()).c_str());
+        w << ", \"file\": ";
+        detail::write_json_string(w, e.first.file.c_str());
+        w << ", \"line\": " << e.first.line
+          << ", \"calls\": " << s.calls
+          << ", \"failures\": " << s.failures
+          << ", \"total_ns\": " << s.total_ns
+          << ", \"mean_ns\": " << double(s.total_ns) / double(s.calls)
+          << ", \"min_ns\": " << s.min_ns
+          << ", \"max_ns\": " << s.max_ns
+          << ", \"p50_ns\": " << s.percentile(0.50)
+          << ", \"p90_ns\": " << s.percentile(0.90)
+          << ", \"p99_ns\": " << s.percentile(0.99) << '}';
+        delim = ",\n  ";
+      }
+      w << "\n]}\n";
+    }
+#else
+    struct site
+    {
+      static constexpr site current() { return site {}; }
+    };
+
+    struct site_scope
+    {
+      explicit site_scope(site) { }
+    };
+#endif
+
+  }; // end stats
+
+  // Result of evaluating a matcher over a column of values: bit i of the
+  // packed words is set when value i matched.
+  class match_mask
+  {
+  public:
+    explicit match_mask(std::size_t size)
+      : words_((size + 63) / 64)
+      , size_(size)
+    { }
+
+    static std::size_t word_count(std::size_t size) { return (size + 63) / 64; }
+
+    std::size_t size() const { return size_; }
+    std::size_t count() const { return count_; }
+    bool all() const { return count_ == size_; }
+    bool none() const { return count_ == 0; }
+
+    bool operator[](std::size_t i) const {
+      return (words_[i / 64] >> (i % 64)) & 1;
+    }
+
+    const std::uint64_t * words() const { return words_.data(); }
+    std::uint64_t * words() { return words_.data(); }
+
+    // Recounts the set bits after words() have been written.
+    void update_count() {
+      count_ = 0;
+      for (std::uint64_t w : words_)
+        count_ += static_cast<std::size_t>(__builtin_popcountll(w));
+    }
+
+  private:
+    std::vector<std::uint64_t> words_;
+    std::size_t size_;
+    std::size_t count_ = 0;
+  };
+
+  // A predicate bound to its arguments. Matchers do not change once built,
+  // so a single matcher can be evaluated from several threads at once.
+  template<template <class...> class Predicate, class ... Ts>
+  class Matcher
+  {
+  public:
+    Matcher(Ts&& ... args)
+      : pred()
+      , args(std::forward<Ts>(args)...) 
+    { }
+
+    template<class T>
+    bool matches(const T &) const;
+    void describe(writer& o) const;
+
+    template<class T>
+    void describe_mismatch(writer& o, const T & actual) const;
+
+    // Index of the element of a container that a failure is about, or
+    // print_limits::none.
+    template<class T>
+    std::size_t mismatch_index(const T & actual) const;
+
+    // Evaluates the matcher over values[0, n), writing one bit per value
+    // into words, which has match_mask::word_count(n) entries.
+    template<class T>
+    void matches_all(const T * values, std::size_t n, 
+        std::uint64_t * words) const;
+
+    template<class T>
+    match_mask matches_all(const T * values, std::size_t n) const;
+
+    template<class C>
+    auto matches_all(const C & column) const
+      -> decltype(std::data(column), std::size(column), match_mask(0));
+
+    // What the predicate was built from, for factories that rewrite a
+    // matcher into a cheaper equivalent.
+    const std::tuple<Ts...> & arguments() const & { return args; }
+    std::tuple<Ts...> && arguments() && { return std::move(args); }
+
+    friend std::ostream& operator<<(std::ostream& o, 
+        const Matcher & matcher) 
+    {
+        writer w(o);
+        matcher.describe(w);
+        return o;
+    }
+
+  private:
+    template <class T, std::size_t... Is>
+    bool matches_impl(const T & actual, std::index_sequence<Is...>) const;
+
+    template <std::size_t... Is>
+    void describe_impl(writer& o, std::index_sequence<Is...>) const;
+
+    template <class T, std::size_t... Is>
+    void describe_mismatch_impl(writer& o, const T & actual,
+        std::index_sequence<Is...>) const;
+
+    template <class T, std::size_t... Is>
+    std::size_t mismatch_index_impl(const T & actual,
+        std::index_sequence<Is...>) const;
+
+    template <class T, std::size_t... Is>
+    void matches_all_impl(const T * values, std::size_t n, 
+        std::uint64_t * words, std::index_sequence<Is...>) const;
+
+    Predicate<predicate_arg_t<Ts>...> pred;
+    std::tuple<Ts...> args;
+  };
+
+  template<template <class...> class Predicate, class ... Ts>
+  template <class T, std::size_t... Is>
+  bool Matcher<Predicate,Ts...>::matches_impl(const T & actual, 
+      std::index_sequence<Is...>) const
+  {
+    return pred.matches(actual, std::get<Is>(args)...);
+  }
+
+  // Predicates that only forward to the matcher they wrap declare
+  // transparent, and are not timed separately from it.
+  template<class P, class = void>
+  struct is_transparent : std::false_type { };
+
+  template<class P>
+  struct is_transparent<P, std::enable_if_t<P::transparent>>
+    : std::true_type { };
+
+  template<template <class...> class Predicate, class ... Ts>
+  template<class T>
+  bool Matcher<Predicate,Ts...>::matches(const T & actual) const
+  {
+#if defined(MATCHA_STATS)
+    if constexpr (is_transparent<Predicate<predicate_arg_t<Ts>...>>::value)
+      return matches_impl(actual, std::index_sequence_for<Ts...>{});
+
+    const auto start = stats::clock::now();
+    const bool matched = 
+      matches_impl(actual, std::index_sequence_for<Ts...>{});
+    stats::record(typeid(pred), start, matched);
+    return matched;
+#else
+    return matches_impl(actual, std::index_sequence_for<Ts...>{});
+#endif
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  template <std::size_t... Is>
+  void Matcher<Predicate,Ts...>::describe_impl(writer& o, 
+      std::index_sequence<Is...>) const
+  {
+    return pred.describe(o, std::get<Is>(args)...);
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  void Matcher<Predicate,Ts...>::describe(writer& o) const
+  {
+    return describe_impl(o, std::index_sequence_for<Ts...>{});
+  }
+
+  // Predicates may explain a failure beyond describe() by providing
+  // describe_mismatch(writer&, actual, args...).
+  template<class P, class T, class Args, class = void>
+  struct has_describe_mismatch : std::false_type { };
+
+  template<class P, class T, class ... Args>
+  struct has_describe_mismatch<P, T, std::tuple<Args...>, 
+    std::void_t<decltype(std::declval<const P &>().describe_mismatch(
+      std::declval<writer &>(), std::declval<const T &>(),
+      std::declval<const Args &>()...))>>
+    : std::true_type { };
+
+  template<template <class...> class Predicate, class ... Ts>
+  template <class T, std::size_t... Is>
+  void Matcher<Predicate,Ts...>::describe_mismatch_impl(writer& o, 
+      const T & actual, std::index_sequence<Is...>) const
+  {
+    if constexpr (has_describe_mismatch<Predicate<predicate_arg_t<Ts>...>, T,
+        std::tuple<Ts...>>::value)
+      pred.describe_mismatch(o, actual, std::get<Is>(args)...);
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  template<class T>
+  void Matcher<Predicate,Ts...>::describe_mismatch(writer& o, 
+      const T & actual) const
+  {
+    describe_mismatch_impl(o, actual, std::index_sequence_for<Ts...>{});
+  }
+
+  // Predicates that can point at the element a failure is about provide
+  // mismatch_index(actual, args...); failure messages print the window of
+  // the container around it.
+  template<class P, class T, class Args, class = void>
+  struct has_mismatch_index : std::false_type { };
+
+  template<class P, class T, class ... Args>
+  struct has_mismatch_index<P, T, std::tuple<Args...>, 
+    std::void_t<decltype(std::declval<const P &>().mismatch_index(
+      std::declval<const T &>(), std::declval<const Args &>()...))>>
+    : std::true_type { };
+
+  template<template <class...> class Predicate, class ... Ts>
+  template <class T, std::size_t... Is>
+  std::size_t Matcher<Predicate,Ts...>::mismatch_index_impl(
+      const T & actual, std::index_sequence<Is...>) const
+  {
+    if constexpr (has_mismatch_index<Predicate<predicate_arg_t<Ts>...>, T,
+        std::tuple<Ts...>>::value)
+      return pred.mismatch_index(actual, std::get<Is>(args)...);
+    else
+      return print_limits::none;
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  template<class T>
+  std::size_t Matcher<Predicate,Ts...>::mismatch_index(
+      const T & actual) const
+  {
+    return mismatch_index_impl(actual, std::index_sequence_for<Ts...>{});
+  }
+
+  // Predicates with a batch kernel provide
+  // matches_all(const T * values, n, words, args...).
+  template<class P, class T, class Args, class = void>
+  struct has_matches_all : std::false_type { };
+
+  template<class P, class T, class ... Args>
+  struct has_matches_all<P, T, std::tuple<Args...>, 
+    std::void_t<decltype(std::declval<const P &>().matches_all(
+      std::declval<const T *>(), std::size_t(), 
+      std::declval<std::uint64_t *>(), std::declval<const Args &>()...))>>
+    : std::true_type { };
+
+  template<template <class...> class Predicate, class ... Ts>
+  template <class T, std::size_t... Is>
+  void Matcher<Predicate,Ts...>::matches_all_impl(const T * values, 
+      std::size_t n, std::uint64_t * words, std::index_sequence<Is...>) const
+  {
+    if constexpr (has_matches_all<Predicate<predicate_arg_t<Ts>...>, T,
+        std::tuple<Ts...>>::value) {
+      pred.matches_all(values, n, words, std::get<Is>(args)...);
+    } else {
+      for (std::size_t i = 0; i < n; i += 64) {
+        const std::size_t m = std::min<std::size_t>(64, n - i);
+        std::uint64_t bits = 0;
+        for (std::size_t j = 0; j < m; ++j)
+          bits |= std::uint64_t(pred.matches(values[i + j], 
+            std::get<Is>(args)...)) << j;
+        words[i / 64] = bits;
+      }
+    }
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  template<class T>
+  void Matcher<Predicate,Ts...>::matches_all(const T * values, std::size_t n,
+      std::uint64_t * words) const
+  {
+    matches_all_impl(values, n, words, std::index_sequence_for<Ts...>{});
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  template<class T>
+  match_mask Matcher<Predicate,Ts...>::matches_all(const T * values, 
+      std::size_t n) const
+  {
+    match_mask mask(n);
+    matches_all(values, n, mask.words());
+    mask.update_count();
+    return mask;
+  }
+
+  template<template <class...> class Predicate, class ... Ts>
+  template<class C>
+  auto Matcher<Predicate,Ts...>::matches_all(const C & column) const
+    -> decltype(std::data(column), std::size(column), match_mask(0))
+  {
+    return matches_all(std::data(column), std::size(column));
+  }
+
+  template<template <class...> class Predicate, class ... T>
+  auto make_matcher(T && ... val) 
+  {
+    return Matcher<Predicate, T...>(std::forward<T>(val)...);
+  }
+
+  template<typename T>
+  struct is_container : pretty_print::is_container<T> { };
+
+  // A [first, last) pair seen as a container, so that container predicates
+  // can consume it without it being materialized. Single-pass iterators are
+  // only traversed once; last may be a sentinel of a different type.
+  template<class Iter, class Sentinel = Iter>
+  class range
+  {
+  public:
+    typedef Iter const_iterator;
+    typedef typename std::iterator_traits<Iter>::value_type value_type;
+
+    range(Iter first, Sentinel last)
+      : first_(std::move(first))
+      , last_(std::move(last))
+    { }
+
+    Iter begin() const { return first_; }
+    Sentinel end() const { return last_; }
+
+  private:
+    Iter first_;
+    Sentinel last_;
+  };
+
+  template<class Iter, class Sentinel>
+  struct is_container<range<Iter,Sentinel>> : std::true_type { };
+
+#if defined(__cpp_lib_ranges)
+  template<class Iter>
+  struct is_multipass : std::bool_constant<std::forward_iterator<Iter>> { };
+#else
+  template<class Iter>
+  struct is_multipass : std::is_base_of<std::forward_iterator_tag,
+    typename std::iterator_traits<Iter>::iterator_category> { };
+#endif
+
+  namespace detail {
+
+    // std::equal and std::find want matching iterator types; these accept
+    // sentinels and stay single pass.
+    template<class I1, class S1, class I2, class S2>
+    bool equal(I1 first1, S1 last1, I2 first2, S2 last2)
+    {
+      for (; first1 != last1 && first2 != last2; ++first1, ++first2) {
+        if (!(*first1 == *first2))
+          return false;
+      }
+      return first1 == last1 && first2 == last2;
+    }
+
+    template<class I, class S, class T>
+    bool contains(I first, S last, const T & value)
+    {
+      for (; first != last; ++first) {
+        if (*first == value)
+          return true;
+      }
+      return false;
+    }
+
+    template<class T>
+    struct is_flat : std::integral_constant<bool,
+      std::is_arithmetic<T>::value || std::is_enum<T>::value ||
+      std::is_pointer<T>::value>
+    { };
+
+    // Elements for which == is the same as comparing object bytes.
+    template<class T>
+    struct is_bitwise_comparable : std::integral_constant<bool,
+      std::is_integral<T>::value || std::is_enum<T>::value ||
+      std::is_pointer<T>::value>
+    { };
+
+    template<class C, class = void>
+    struct is_random_access : std::false_type { };
+
+    template<class C>
+    struct is_random_access<C, std::enable_if_t<std::is_same<
+        decltype(std::begin(std::declval<const C &>())),
+        decltype(std::end(std::declval<const C &>()))>::value>>
+      : std::is_base_of<std::random_access_iterator_tag,
+          typename std::iterator_traits<decltype(
+            std::begin(std::declval<const C &>()))>::iterator_category>
+    { };
+
+    // Contiguous storage of arithmetic, enum or pointer elements, which the
+    // predicates below hand to the simd kernels instead of iterating.
+    template<class C, class = void>
+    struct contiguous : std::false_type { };
+
+    template<class T, std::size_t N>
+    struct contiguous<T[N], std::enable_if_t<is_flat<T>::value>>
+      : std::true_type
+    {
+      typedef T value_type;
+      static const T * data(const T (&c)[N]) { return c; }
+      static std::size_t size(const T (&)[N]) { return N; }
+    };
+
+    template<class T, std::size_t N>
+    struct contiguous<std::array<T,N>,
+        std::enable_if_t<is_flat<T>::value>>
+      : std::true_type
+    {
+      typedef T value_type;
+      static const T * data(const std::array<T,N> & c) { return c.data(); }
+      static std::size_t size(const std::array<T,N> &) { return N; }
+    };
+
+    template<class T, class A>
+    struct contiguous<std::vector<T,A>,
+        std::enable_if_t<is_flat<T>::value 
+                     && !std::is_same<T, bool>::value>>
+      : std::true_type
+    {
+      typedef T value_type;
+      static const T * data(const std::vector<T,A> & c) { return c.data(); }
+      static std::size_t size(const std::vector<T,A> & c) { return c.size(); }
+    };
+
+    template<class T>
+    struct contiguous<std::valarray<T>,
+        std::enable_if_t<is_flat<T>::value>>
+      : std::true_type
+    {
+      typedef T value_type;
+      static const T * data(const std::valarray<T> & c) {
+        return c.size() ? &c[0] : nullptr;
+      }
+      static std::size_t size(const std::valarray<T> & c) { return c.size(); }
+    };
+
+    template<class T>
+    struct contiguous<range<T*,T*>,
+        std::enable_if_t<is_flat<std::remove_const_t<T>>::value>>
+      : std::true_type
+    {
+      typedef std::remove_const_t<T> value_type;
+      static const value_type * data(const range<T*,T*> & c) {
+        return c.begin(); 
+      }
+      static std::size_t size(const range<T*,T*> & c) {
+        return static_cast<std::size_t>(c.end() - c.begin());
+      }
+    };
+
+  }; // end detail
+
+  // Vectorized kernels over arithmetic arrays. SSE2 is the x86-64 baseline,
+  // AVX2 is picked at runtime when the CPU has it; everything else runs the
+  // scalar loop.
+  namespace simd {
+
+    template<class T>
+    struct is_vectorizable : std::integral_constant<bool,
+      std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+      !std::is_same<T, long double>::value &&
+      (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)>
+    { };
+
+    template<class T>
+    std::size_t find_scalar(const T * data, std::size_t n, T value)
+    {
+      for (std::size_t i = 0; i < n; ++i) {
+        if (data[i] == value)
+          return i;
+      }
+      return n;
+    }
+
+    // Whether a is within atol + rtol * |e| of e. NaN is close to nothing
+    // and an infinity only to itself; the vector kernels below evaluate
+    // the same expression lane by lane.
+    template<class T>
+    bool is_close(T a, T e, T rtol, T atol)
+    {
+      const T d = std::abs(a - e);
+      return a == e || (d <= atol + rtol * std::abs(e) &&
+        d < std::numeric_limits<T>::infinity());
+    }
+
+    template<class T>
+    std::size_t find_not_close_scalar(const T * a, const T * e, 
+        std::size_t n, T rtol, T atol)
+    {
+      for (std::size_t i = 0; i < n; ++i) {
+        if (!is_close(a[i], e[i], rtol, atol))
+          return i;
+      }
+      return n;
+    }
+
+#if defined(MATCHA_SIMD_X86)
+    inline bool has_avx2()
+    {
+      static const bool avx2 = __builtin_cpu_supports("avx2");
+      return avx2;
+    }
+
+    inline unsigned lowest_bit(std::uint32_t mask)
+    {
+      return static_cast<unsigned>(__builtin_ctz(mask));
+    }
+
+    template<class T, class = void>
+    struct sse2;
+
+    template<class T>
+    struct sse2<T, std::enable_if_t<std::is_integral<T>::value>>
+    {
+      static __m128i load(const T * p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      }
+
+      static __m128i set1(T v) {
+        if constexpr (sizeof(T) == 1) return _mm_set1_epi8(static_cast<char>(v));
+        else if constexpr (sizeof(T) == 2) return _mm_set1_epi16(static_cast<short>(v));
+        else if constexpr (sizeof(T) == 4) return _mm_set1_epi32(static_cast<int>(v));
+        else return _mm_set1_epi64x(static_cast<long long>(v));
+      }
+
+      static __m128i eq(__m128i a, __m128i b) {
+        if constexpr (sizeof(T) == 1) return _mm_cmpeq_epi8(a, b);
+        else if constexpr (sizeof(T) == 2) return _mm_cmpeq_epi16(a, b);
+        else if constexpr (sizeof(T) == 4) return _mm_cmpeq_epi32(a, b);
+        else {
+          // no 64-bit compare before SSE4.1: both 32-bit halves must match
+          __m128i e = _mm_cmpeq_epi32(a, b);
+          return _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2,3,0,1)));
+        }
+      }
+    };
+
+    // The comparisons are ordered: a NaN lane compares false.
+    template<>
+    struct sse2<float>
+    {
+      static __m128 load(const float * p) { return _mm_loadu_ps(p); }
+      static __m128 set1(float v) { return _mm_set1_ps(v); }
+      static __m128i eq(__m128 a, __m128 b) {
+        return _mm_castps_si128(_mm_cmpeq_ps(a, b));
+      }
+      static __m128i le(__m128 a, __m128 b) {
+        return _mm_castps_si128(_mm_cmple_ps(a, b));
+      }
+      static __m128i lt(__m128 a, __m128 b) {
+        return _mm_castps_si128(_mm_cmplt_ps(a, b));
+      }
+      static __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+      static __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+      static __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+      static __m128 abs(__m128 a) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+      }
+    };
+
+    template<>
+    struct sse2<double>
+    {
+      static __m128d load(const double * p) { return _mm_loadu_pd(p); }
+      static __m128d set1(double v) { return _mm_set1_pd(v); }
+      static __m128i eq(__m128d a, __m128d b) {
+        return _mm_castpd_si128(_mm_cmpeq_pd(a, b));
+      }
+      static __m128i le(__m128d a, __m128d b) {
+        return _mm_castpd_si128(_mm_cmple_pd(a, b));
+      }
+      static __m128i lt(__m128d a, __m128d b) {
+        return _mm_castpd_si128(_mm_cmplt_pd(a, b));
+      }
+      static __m128d add(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+      static __m128d sub(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+      static __m128d mul(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+      static __m128d abs(__m128d a) {
+        return _mm_andnot_pd(_mm_set1_pd(-0.0), a);
+      }
+    };
+
+    template<class T>
+    std::size_t find_sse2(const T * data, std::size_t n, T value)
+    {
+      typedef sse2<T> ops;
+      constexpr std::size_t lanes = 16 / sizeof(T);
+
+      const auto needle = ops::set1(value);
+      std::size_t i = 0;
+
+      for (; i + 4 * lanes <= n; i += 4 * lanes) {
+        __m128i e0 = ops::eq(ops::load(data + i), needle);
+        __m128i e1 = ops::eq(ops::load(data + i + lanes), needle);
+        __m128i e2 = ops::eq(ops::load(data + i + 2 * lanes), needle);
+        __m128i e3 = ops::eq(ops::load(data + i + 3 * lanes), needle);
+        __m128i any = _mm_or_si128(_mm_or_si128(e0, e1), _mm_or_si128(e2, e3));
+        if (_mm_movemask_epi8(any) != 0)
+          break;
+      }
+
+      for (; i + lanes <= n; i += lanes) {
+        auto mask = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(ops::eq(ops::load(data + i), needle)));
+        if (mask != 0)
+          return i + lowest_bit(mask) / sizeof(T);
+      }
+
+      return i + find_scalar(data + i, n - i, value);
+    }
+
+    template<class T, class = void>
+    struct avx2;
+
+    template<class T>
+    struct avx2<T, std::enable_if_t<std::is_integral<T>::value>>
+    {
+      __attribute__((target("avx2")))
+      static __m256i load(const T * p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256i set1(T v) {
+        if constexpr (sizeof(T) == 1) return _mm256_set1_epi8(static_cast<char>(v));
+        else if constexpr (sizeof(T) == 2) return _mm256_set1_epi16(static_cast<short>(v));
+        else if constexpr (sizeof(T) == 4) return _mm256_set1_epi32(static_cast<int>(v));
+        else return _mm256_set1_epi64x(static_cast<long long>(v));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256i eq(__m256i a, __m256i b) {
+        if constexpr (sizeof(T) == 1) return _mm256_cmpeq_epi8(a, b);
+        else if constexpr (sizeof(T) == 2) return _mm256_cmpeq_epi16(a, b);
+        else if constexpr (sizeof(T) == 4) return _mm256_cmpeq_epi32(a, b);
+        else return _mm256_cmpeq_epi64(a, b);
+      }
+    };
+
+    template<>
+    struct avx2<float>
+    {
+      __attribute__((target("avx2")))
+      static __m256 load(const float * p) { return _mm256_loadu_ps(p); }
+
+      __attribute__((target("avx2")))
+      static __m256 set1(float v) { return _mm256_set1_ps(v); }
+
+      __attribute__((target("avx2")))
+      static __m256i eq(__m256 a, __m256 b) {
+        return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_EQ_OQ));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256i le(__m256 a, __m256 b) {
+        return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LE_OQ));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256i lt(__m256 a, __m256 b) {
+        return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+
+      __attribute__((target("avx2")))
+      static __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+
+      __attribute__((target("avx2")))
+      static __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+
+      __attribute__((target("avx2")))
+      static __m256 abs(__m256 a) {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+      }
+    };
+
+    template<>
+    struct avx2<double>
+    {
+      __attribute__((target("avx2")))
+      static __m256d load(const double * p) { return _mm256_loadu_pd(p); }
+
+      __attribute__((target("avx2")))
+      static __m256d set1(double v) { return _mm256_set1_pd(v); }
+
+      __attribute__((target("avx2")))
+      static __m256i eq(__m256d a, __m256d b) {
+        return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_EQ_OQ));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256i le(__m256d a, __m256d b) {
+        return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_LE_OQ));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256i lt(__m256d a, __m256d b) {
+        return _mm256_castpd_si256(_mm256_cmp_pd(a, b, _CMP_LT_OQ));
+      }
+
+      __attribute__((target("avx2")))
+      static __m256d add(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+
+      __attribute__((target("avx2")))
+      static __m256d sub(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+
+      __attribute__((target("avx2")))
+      static __m256d mul(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+
+      __attribute__((target("avx2")))
+      static __m256d abs(__m256d a) {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+      }
+    };
+
+    template<class T>
+    __attribute__((target("avx2")))
+    std::size_t find_avx2(const T * data, std::size_t n, T value)
+    {
+      typedef avx2<T> ops;
+      constexpr std::size_t lanes = 32 / sizeof(T);
+
+      const auto needle = ops::set1(value);
+      std::size_t i = 0;
+
+      for (; i + 4 * lanes <= n; i += 4 * lanes) {
+        __m256i e0 = ops::eq(ops::load(data + i), needle);
+        __m256i e1 = ops::eq(ops::load(data + i + lanes), needle);
+        __m256i e2 = ops::eq(ops::load(data + i + 2 * lanes), needle);
+        __m256i e3 = ops::eq(ops::load(data + i + 3 * lanes), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(e0, e1),
+                                      _mm256_or_si256(e2, e3));
+        if (!_mm256_testz_si256(any, any))
+          break;
+      }
+
+      for (; i + lanes <= n; i += lanes) {
+        auto mask = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(ops::eq(ops::load(data + i), needle)));
+        if (mask != 0)
+          return i + lowest_bit(mask) / sizeof(T);
+      }
+
+      return i + find_scalar(data + i, n - i, value);
+    }
+
+    // is_close for each lane of x against y.
+    template<class T, class V>
+    __m128i close_sse2(V x, V y, V rtol, V atol, V inf)
+    {
+      typedef sse2<T> ops;
+      const V d = ops::abs(ops::sub(x, y));
+      return _mm_or_si128(ops::eq(x, y), _mm_and_si128(
+        ops::le(d, ops::add(atol, ops::mul(rtol, ops::abs(y)))), 
+        ops::lt(d, inf)));
+    }
+
+    template<class T>
+    std::size_t find_not_close_sse2(const T * a, const T * e, std::size_t n,
+        T rtol, T atol)
+    {
+      typedef sse2<T> ops;
+      constexpr std::size_t lanes = 16 / sizeof(T);
+
+      const auto r = ops::set1(rtol);
+      const auto t = ops::set1(atol);
+      const auto inf = ops::set1(std::numeric_limits<T>::infinity());
+      std::size_t i = 0;
+
+      for (; i + 2 * lanes <= n; i += 2 * lanes) {
+        __m128i all = _mm_and_si128(
+          close_sse2<T>(ops::load(a + i), ops::load(e + i), r, t, inf),
+          close_sse2<T>(ops::load(a + i + lanes), ops::load(e + i + lanes),
+            r, t, inf));
+        if (_mm_movemask_epi8(all) != 0xffff)
+          break;
+      }
+
+      for (; i + lanes <= n; i += lanes) {
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(
+          close_sse2<T>(ops::load(a + i), ops::load(e + i), r, t, inf)));
+        if (mask != 0xffff)
+          return i + lowest_bit(~mask) / sizeof(T);
+      }
+
+      return i + find_not_close_scalar(a + i, e + i, n - i, rtol, atol);
+    }
+
+    template<class T, class V>
+    __attribute__((target("avx2")))
+    __m256i close_avx2(V x, V y, V rtol, V atol, V inf)
+    {
+      typedef avx2<T> ops;
+      const V d = ops::abs(ops::sub(x, y));
+      return _mm256_or_si256(ops::eq(x, y), _mm256_and_si256(
+        ops::le(d, ops::add(atol, ops::mul(rtol, ops::abs(y)))), 
+        ops::lt(d, inf)));
+    }
+
+    template<class T>
+    __attribute__((target("avx2")))
+    std::size_t find_not_close_avx2(const T * a, const T * e, std::size_t n,
+        T rtol, T atol)
+    {
+      typedef avx2<T> ops;
+      constexpr std::size_t lanes = 32 / sizeof(T);
+
+      const auto r = ops::set1(rtol);
+      const auto t = ops::set1(atol);
+      const auto inf = ops::set1(std::numeric_limits<T>::infinity());
+      std::size_t i = 0;
+
+      for (; i + 2 * lanes <= n; i += 2 * lanes) {
+        __m256i all = _mm256_and_si256(
+          close_avx2<T>(ops::load(a + i), ops::load(e + i), r, t, inf),
+          close_avx2<T>(ops::load(a + i + lanes), ops::load(e + i + lanes),
+            r, t, inf));
+        if (static_cast<std::uint32_t>(_mm256_movemask_epi8(all)) != 
+            0xffffffffu)
+          break;
+      }
+
+      for (; i + lanes <= n; i += lanes) {
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+          close_avx2<T>(ops::load(a + i), ops::load(e + i), r, t, inf)));
+        if (mask != 0xffffffffu)
+          return i + lowest_bit(~mask) / sizeof(T);
+      }
+
+      return i + find_not_close_scalar(a + i, e + i, n - i, rtol, atol);
+    }
+
+    inline std::size_t mismatch_sse2(const unsigned char * a,
+        const unsigned char * b, std::size_t n)
+    {
+      std::size_t i = 0;
+
+      for (; i + 64 <= n; i += 64) {
+        __m128i e0 = _mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 32)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 48)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 48)));
+        __m128i all = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+        if (_mm_movemask_epi8(all) != 0xffff)
+          break;
+      }
+
+      for (; i + 16 <= n; i += 16) {
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)))));
+        if (mask != 0xffff)
+          return i + lowest_bit(~mask);
+      }
+
+      for (; i < n && a[i] == b[i]; ++i) { }
+      return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline std::size_t mismatch_avx2(const unsigned char * a,
+        const unsigned char * b, std::size_t n)
+    {
+      std::size_t i = 0;
+
+      for (; i + 128 <= n; i += 128) {
+        __m256i e0 = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        __m256i e1 = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 32)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 32)));
+        __m256i e2 = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 64)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 64)));
+        __m256i e3 = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i + 96)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 96)));
+        __m256i all = _mm256_and_si256(_mm256_and_si256(e0, e1),
+                                       _mm256_and_si256(e2, e3));
+        if (static_cast<std::uint32_t>(_mm256_movemask_epi8(all)) != 0xffffffffu)
+          break;
+      }
+
+      for (; i + 32 <= n; i += 32) {
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)))));
+        if (mask != 0xffffffffu)
+          return i + lowest_bit(~mask);
+      }
+
+      for (; i < n && a[i] == b[i]; ++i) { }
+      return i;
+    }
+
+    // Substring search filtering candidate positions on the needle's first
+    // and last bytes, 16 or 32 positions at a time; only candidates passing
+    // both are compared in full. Needles are at least two bytes long.
+    inline std::size_t search_sse2(const char * s, std::size_t n,
+        const char * needle, std::size_t k)
+    {
+      const __m128i first = _mm_set1_epi8(needle[0]);
+      const __m128i last = _mm_set1_epi8(needle[k - 1]);
+      std::size_t i = 0;
+
+      for (; i + k + 15 <= n; i += 16) {
+        __m128i f = _mm_cmpeq_epi8(first,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i)));
+        __m128i l = _mm_cmpeq_epi8(last,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + k - 1)));
+        auto mask = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_and_si128(f, l)));
+
+        for (; mask != 0; mask &= mask - 1) {
+          unsigned bit = lowest_bit(mask);
+          if (std::memcmp(s + i + bit + 1, needle + 1, k - 2) == 0)
+            return i + bit;
+        }
+      }
+
+      std::size_t tail = std::string_view(s + i, n - i).find(
+          std::string_view(needle, k));
+      return tail == std::string_view::npos ? tail : i + tail;
+    }
+
+    __attribute__((target("avx2")))
+    inline std::size_t search_avx2(const char * s, std::size_t n,
+        const char * needle, std::size_t k)
+    {
+      const __m256i first = _mm256_set1_epi8(needle[0]);
+      const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+      std::size_t i = 0;
+
+      for (; i + k + 31 <= n; i += 32) {
+        __m256i f = _mm256_cmpeq_epi8(first,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i)));
+        __m256i l = _mm256_cmpeq_epi8(last,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + k - 1)));
+        auto mask = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(f, l)));
+
+        for (; mask != 0; mask &= mask - 1) {
+          unsigned bit = lowest_bit(mask);
+          if (std::memcmp(s + i + bit + 1, needle + 1, k - 2) == 0)
+            return i + bit;
+        }
+      }
+
+      std::size_t tail = std::string_view(s + i, n - i).find(
+          std::string_view(needle, k));
+      return tail == std::string_view::npos ? tail : i + tail;
+    }
+#endif
+
+    // Offset of the first differing byte, or n.
+    inline std::size_t mismatch_bytes(const void * a, const void * b,
+        std::size_t n)
+    {
+      auto x = static_cast<const unsigned char *>(a);
+      auto y = static_cast<const unsigned char *>(b);
+#if defined(MATCHA_SIMD_X86)
+      if (has_avx2())
+        return mismatch_avx2(x, y, n);
+      return mismatch_sse2(x, y, n);
+#else
+      std::size_t i = 0;
+      for (; i < n && x[i] == y[i]; ++i) { }
+      return i;
+#endif
+    }
+
+    // Index of the first element that differs, or n. Only meaningful for
+    // elements whose == compares object bytes.
+    template<class T>
+    std::size_t mismatch(const T * a, const T * b, std::size_t n)
+    {
+      return mismatch_bytes(a, b, n * sizeof(T)) / sizeof(T);
+    }
+
+    // Index of the first element equal to value, or n.
+    template<class T>
+    std::size_t find(const T * data, std::size_t n, T value)
+    {
+      static_assert(is_vectorizable<T>::value, "expects an arithmetic type");
+#if defined(MATCHA_SIMD_X86)
+      if (has_avx2())
+        return find_avx2(data, n, value);
+      return find_sse2(data, n, value);
+#else
+      return find_scalar(data, n, value);
+#endif
+    }
+
+    // Index of the first i for which is_close(a[i], e[i], rtol, atol) is
+    // false, or n.
+    template<class T>
+    std::size_t find_not_close(const T * a, const T * e, std::size_t n,
+        T rtol, T atol)
+    {
+      static_assert(std::is_same<T, float>::value || 
+        std::is_same<T, double>::value, "expects float or double");
+#if defined(MATCHA_SIMD_X86)
+      if (has_avx2())
+        return find_not_close_avx2(a, e, n, rtol, atol);
+      return find_not_close_sse2(a, e, n, rtol, atol);
+#else
+      return find_not_close_scalar(a, e, n, rtol, atol);
+#endif
+    }
+
+    // Packs 64 flags of 0 or 1 into a word, flag j into bit j.
+    inline std::uint64_t pack64(const unsigned char * flags)
+    {
+#if defined(MATCHA_SIMD_X86)
+      const __m128i zero = _mm_setzero_si128();
+      std::uint64_t bits = 0;
+      for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(flags + 16 * k));
+        bits |= std::uint64_t(static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_sub_epi8(zero, v)))) << (16 * k);
+      }
+      return bits;
+#else
+      std::uint64_t bits = 0;
+      for (int j = 0; j < 64; ++j)
+        bits |= std::uint64_t(flags[j]) << j;
+      return bits;
+#endif
+    }
+
+    // Batch kernel for leaf predicates: f is evaluated over blocks of 64
+    // values into a byte array, a branch-free loop the compiler vectorizes
+    // for arithmetic values, and each block is packed into one word.
+    template<class T, class F>
+    void mask_if(const T * values, std::size_t n, std::uint64_t * words, F f)
+    {
+      alignas(16) unsigned char flags[64];
+      std::size_t i = 0;
+
+      for (; i + 64 <= n; i += 64) {
+        for (std::size_t j = 0; j < 64; ++j)
+          flags[j] = static_cast<unsigned char>(f(values[i + j]));
+        words[i / 64] = pack64(flags);
+      }
+
+      if (i < n) {
+        for (std::size_t j = 0; j < 64; ++j)
+          flags[j] = static_cast<unsigned char>(i + j < n && f(values[i + j]));
+        words[i / 64] = pack64(flags);
+      }
+    }
+
+    inline void or_words(std::uint64_t * words, const std::uint64_t * other,
+        std::size_t count)
+    {
+      for (std::size_t i = 0; i < count; ++i)
+        words[i] |= other[i];
+    }
+
+    // Flips the n valid bits of a mask, leaving the padding bits clear.
+    inline void invert_words(std::uint64_t * words, std::size_t n)
+    {
+      for (std::size_t i = 0; i < n / 64; ++i)
+        words[i] = ~words[i];
+      if (n % 64 != 0)
+        words[n / 64] = ~words[n / 64] & ((std::uint64_t(1) << (n % 64)) - 1);
+    }
+
+    // Offset of the first occurrence of needle in s, or npos.
+    inline std::size_t search(std::string_view s, std::string_view needle)
+    {
+      const std::size_t n = s.size();
+      const std::size_t k = needle.size();
+
+      if (k == 0)
+        return 0;
+      if (k > n)
+        return std::string_view::npos;
+      if (k == 1) {
+        std::size_t i = find(s.data(), n, needle[0]);
+        return i == n ? std::string_view::npos : i;
+      }
+#if defined(MATCHA_SIMD_X86)
+      if (has_avx2())
+        return search_avx2(s.data(), n, needle.data(), k);
+      return search_sse2(s.data(), n, needle.data(), k);
+#else
+      return s.find(needle);
+#endif
+    }
+
+  }; // end simd
+
+  template<typename>
+  struct is_matcher : std::false_type { };
+
+  template<template <class...> class Predicate, class ... Ts>
+  struct is_matcher<Matcher<Predicate,Ts...>>: std::true_type { };
+
+  // Any matcher for values of type T behind one type, so that matchers
+  // built at run time can be kept in containers or passed across
+  // translation units. Matchers of up to inline_size bytes that move
+  // without throwing are stored in place, larger ones on the heap; each
+  // call goes through a single indirect call. A moved-from AnyMatcher can
+  // only be assigned to or destroyed.
+  template<typename T>
+  class AnyMatcher
+  {
+  public:
+    static constexpr std::size_t inline_size = 64;
+
+    template<class M, typename = std::enable_if_t<
+      is_matcher<std::decay_t<M>>::value &&
+      !std::is_same<std::decay_t<M>, AnyMatcher>::value>>
+    AnyMatcher(M && matcher)
+      : ops_(&model<std::decay_t<M>>::ops)
+    {
+      static_assert(std::is_copy_constructible<std::decay_t<M>>::value,
+        "AnyMatcher expects a copyable Matcher");
+      model<std::decay_t<M>>::create(storage_, std::forward<M>(matcher));
+    }
+
+    AnyMatcher(const AnyMatcher & other)
+      : ops_(other.ops_)
+    {
+      if (ops_)
+        ops_->copy(other.storage_, storage_);
+    }
+
+    AnyMatcher(AnyMatcher && other) noexcept
+      : ops_(other.ops_)
+    {
+      if (ops_)
+        ops_->move(other.storage_, storage_);
+      other.ops_ = nullptr;
+    }
+
+    AnyMatcher & operator=(const AnyMatcher & other) {
+      if (this != &other)
+        *this = AnyMatcher(other);
+      return *this;
+    }
+
+    AnyMatcher & operator=(AnyMatcher && other) noexcept {
+      if (this != &other) {
+        reset();
+        if ((ops_ = other.ops_))
+          ops_->move(other.storage_, storage_);
+        other.ops_ = nullptr;
+      }
+      return *this;
+    }
+
+    ~AnyMatcher() { reset(); }
+
+    bool matches(const T & actual) const {
+      return ops_->matches(storage_, actual);
+    }
+
+    void describe(writer& o) const { ops_->describe(storage_, o); }
+
+    void describe_mismatch(writer& o, const T & actual) const {
+      ops_->describe_mismatch(storage_, o, actual);
+    }
+
+    std::size_t mismatch_index(const T & actual) const {
+      return ops_->mismatch_index(storage_, actual);
+    }
+
+    void matches_all(const T * values, std::size_t n,
+        std::uint64_t * words) const {
+      ops_->matches_all(storage_, values, n, words);
+    }
+
+    match_mask matches_all(const T * values, std::size_t n) const {
+      match_mask mask(n);
+      matches_all(values, n, mask.words());
+      mask.update_count();
+      return mask;
+    }
+
+    template<class C>
+    auto matches_all(const C & column) const
+      -> decltype(std::data(column), std::size(column), match_mask(0))
+    {
+      return matches_all(std::data(column), std::size(column));
+    }
+
+    friend std::ostream& operator<<(std::ostream& o, 
+        const AnyMatcher & matcher) 
+    {
+        writer w(o);
+        matcher.describe(w);
+        return o;
+    }
+
+  private:
+    union storage
+    {
+      alignas(std::max_align_t) unsigned char buffer[inline_size];
+      void * heap;
+    };
+
+    struct operations
+    {
+      bool (*matches)(const storage &, const T &);
+      void (*describe)(const storage &, writer &);
+      void (*describe_mismatch)(const storage &, writer &, const T &);
+      std::size_t (*mismatch_index)(const storage &, const T &);
+      void (*matches_all)(const storage &, const T *, std::size_t,
+        std::uint64_t *);
+      void (*copy)(const storage &, storage &);
+      void (*move)(storage &, storage &) noexcept;
+      void (*destroy)(storage &) noexcept;
+    };
+
+    template<class M>
+    struct model
+    {
+      static constexpr bool in_place = sizeof(M) <= inline_size &&
+        alignof(M) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<M>::value;
+
+      static const M & get(const storage & s) {
+        if constexpr (in_place)
+          return *std::launder(reinterpret_cast<const M *>(s.buffer));
+        else
+          return *static_cast<const M *>(s.heap);
+      }
+
+      static M & get(storage & s) {
+        return const_cast<M &>(get(static_cast<const storage &>(s)));
+      }
+
+      template<class A>
+      static void create(storage & s, A && matcher) {
+        if constexpr (in_place)
+          ::new (static_cast<void *>(s.buffer)) M(std::forward<A>(matcher));
+        else
+          s.heap = new M(std::forward<A>(matcher));
+      }
+
+      static bool matches(const storage & s, const T & actual) {
+        return get(s).matches(actual);
+      }
+
+      static void describe(const storage & s, writer & o) {
+        get(s).describe(o);
+      }
+
+      static void describe_mismatch(const storage & s, writer & o,
+          const T & actual) {
+        get(s).describe_mismatch(o, actual);
+      }
+
+      static std::size_t mismatch_index(const storage & s,
+          const T & actual) {
+        return get(s).mismatch_index(actual);
+      }
+
+      static void matches_all(const storage & s, const T * values,
+          std::size_t n, std::uint64_t * words) {
+        get(s).matches_all(values, n, words);
+      }
+
+      static void copy(const storage & from, storage & to) {
+        create(to, get(from));
+      }
+
+      static void move(storage & from, storage & to) noexcept {
+        if constexpr (in_place) {
+          create(to, std::move(get(from)));
+          get(from).~M();
+        } else {
+          to.heap = from.heap;
+        }
+      }
+
+      static void destroy(storage & s) noexcept {
+        if constexpr (in_place)
+          get(s).~M();
+        else
+          delete static_cast<M *>(s.heap);
+      }
+
+      static constexpr operations ops = {
+        matches, describe, describe_mismatch, mismatch_index, matches_all,
+        copy, move, destroy
+      };
+    };
+
+    void reset() noexcept {
+      if (ops_)
+        ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+
+    const operations * ops_;
+    storage storage_;
+  };
+
+  template<typename T>
+  struct is_matcher<AnyMatcher<T>>: std::true_type { };
+
+  template<typename T>
+  struct To 
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    static constexpr bool transparent = true;
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const
+    {
+      return expected.matches(actual);
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "to " << expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      expected.matches_all(values, n, words);
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, 
+        const T & expected) const {
+      expected.describe_mismatch(o, actual);
+    }
+
+    template<typename U>
+    std::size_t mismatch_index(const U & actual, const T & expected) const {
+      return expected.mismatch_index(actual);
+    }
+  };
+
+  template<typename T>
+  struct Be 
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    static constexpr bool transparent = true;
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const
+    {
+      return expected.matches(actual);
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "be " << expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      expected.matches_all(values, n, words);
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, 
+        const T & expected) const {
+      expected.describe_mismatch(o, actual);
+    }
+
+    template<typename U>
+    std::size_t mismatch_index(const U & actual, const T & expected) const {
+      return expected.mismatch_index(actual);
+    }
+  };
+
+  template<typename T>
+  struct Have 
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    static constexpr bool transparent = true;
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const
+    {
+      return expected.matches(actual);
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "have " << expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      expected.matches_all(values, n, words);
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, 
+        const T & expected) const {
+      expected.describe_mismatch(o, actual);
+    }
+
+    template<typename U>
+    std::size_t mismatch_index(const U & actual, const T & expected) const {
+      return expected.mismatch_index(actual);
+    }
+  };
+
+  template<typename T>
+  struct Not 
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      return !expected.matches(actual);
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "not " << expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      expected.matches_all(values, n, words);
+      simd::invert_words(words, n);
+    }
+  };
+
+  namespace detail {
+
+    enum class word { to, be, have, not_ };
+
+    // Words in front of a matcher that do not change what it matches.
+    template<word ... Ws>
+    struct words
+    {
+      static void describe(writer& o) {
+        ((o << (Ws == word::to ? "to " : Ws == word::be ? "be " : 
+          Ws == word::have ? "have " : "not ")), ...);
+      }
+    };
+
+    template<class A, class B>
+    struct join_words;
+
+    template<word ... As, word ... Bs>
+    struct join_words<words<As...>, words<Bs...>> {
+      typedef words<As..., Bs...> type;
+    };
+
+  }; // end detail
+
+  // The form the factories give to to, be, have and pairs of not: W only
+  // describes T, which is evaluated directly, however deeply the words
+  // were nested.
+  template<class W, class T>
+  struct Phrased
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    static constexpr bool transparent = true;
+
+    template<typename U>
+    bool matches(const U & actual, const W &, const T & expected) const {
+      return expected.matches(actual);
+    }
+
+    void describe(writer& o, const W &, const T & expected) const {
+      W::describe(o);
+      o << expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const W &, const T & expected) const {
+      expected.matches_all(values, n, words);
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, const W &,
+        const T & expected) const {
+      expected.describe_mismatch(o, actual);
+    }
+
+    template<typename U>
+    std::size_t mismatch_index(const U & actual, const W &,
+        const T & expected) const {
+      return expected.mismatch_index(actual);
+    }
+  };
+
+  template<typename T, class = void>
+  struct IsEqual
+  {
+    bool matches(const T & actual, const T & expected) const {
+      return actual == expected;
+    }
+
+    // Values are converted to T first, as matches() takes them.
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      simd::mask_if(values, n, words, [e = expected](const U & v) { 
+        return static_cast<T>(v) == e;
+      });
+    }
+
+    void describe(writer& o, T const& expected) const {
+       o << "equal " << expected;
+    }
+  };
+
+  template<typename T>
+  struct IsLessThan
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      return actual < expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      simd::mask_if(values, n, words, [e = expected](const U & v) { 
+        return v < e;
+      });
+    }
+
+    void describe(writer& o, T const& expected) const {
+       o << "less than " << expected;
+    }
+  };
+
+  template<typename T>
+  struct IsGreaterThan
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      return actual > expected;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected) const {
+      simd::mask_if(values, n, words, [e = expected](const U & v) { 
+        return v > e;
+      });
+    }
+
+    void describe(writer& o, T const& expected) const {
+       o << "greater than " << expected;
+    }
+  };
+
+  namespace detail {
+
+    template<class C>
+    using element_t = 
+      std::decay_t<decltype(*std::begin(std::declval<const C &>()))>;
+
+    // The type approximate comparisons of A and B compute in: their common
+    // type if that is floating-point, double otherwise.
+    template<class A, class B>
+    using real_t = std::conditional_t<
+      std::is_floating_point<std::common_type_t<A, B>>::value,
+      std::common_type_t<A, B>, double>;
+
+    // Representable values between a and b, or the largest distance when
+    // either is NaN. Ordering the bit patterns as integers puts negative
+    // values below the positive ones, with -0 and +0 together.
+    template<class T>
+    std::uint64_t ulp_distance(T a, T b)
+    {
+      static_assert(std::is_same<T, float>::value || 
+        std::is_same<T, double>::value, "expects float or double");
+      typedef std::conditional_t<sizeof(T) == 4, std::int32_t, std::int64_t>
+        bits;
+
+      if (a != a || b != b)
+        return std::numeric_limits<std::uint64_t>::max();
+
+      auto ordered = [](T v) {
+        bits i;
+        std::memcpy(&i, &v, sizeof i);
+        return i < 0 ? std::int64_t(std::numeric_limits<bits>::min()) - i
+                     : std::int64_t(i);
+      };
+
+      const std::int64_t x = ordered(a);
+      const std::int64_t y = ordered(b);
+      return x > y ? std::uint64_t(x) - std::uint64_t(y)
+                   : std::uint64_t(y) - std::uint64_t(x);
+    }
+
+  }; // end detail
+
+  template<typename T, typename Tolerance>
+  struct IsCloseTo
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected, 
+        const Tolerance & tolerance) const {
+      typedef detail::real_t<U, T> R;
+      return simd::is_close(R(actual), R(expected), R(0), R(tolerance));
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected, const Tolerance & tolerance) const {
+      typedef detail::real_t<U, T> R;
+      simd::mask_if(values, n, words, 
+        [e = R(expected), t = R(tolerance)](const U & v) { 
+          return simd::is_close(R(v), e, R(0), t);
+        });
+    }
+
+    void describe(writer& o, const T & expected, 
+        const Tolerance & tolerance) const {
+      o << "close to " << expected << " within " << tolerance;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, const T & expected,
+        const Tolerance &) const {
+      typedef detail::real_t<U, T> R;
+      o << ", differs by " << std::abs(R(actual) - R(expected));
+    }
+  };
+
+  template<typename T, typename N>
+  struct IsWithinUlps
+  {
+    static_assert(std::is_floating_point<T>::value, 
+      "expects a floating-point value");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected, const N & ulps) const {
+      return detail::ulp_distance(T(actual), expected) <= ulps;
+    }
+
+    template<typename U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & expected, const N & ulps) const {
+      simd::mask_if(values, n, words, [e = expected, ulps](const U & v) { 
+        return detail::ulp_distance(T(v), e) <= ulps;
+      });
+    }
+
+    void describe(writer& o, const T & expected, const N & ulps) const {
+      o << "within " << ulps << " ulps of " << expected;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, const T & expected,
+        const N &) const {
+      if (T(actual) != T(actual) || expected != expected)
+        o << ", but NaN is close to nothing";
+      else
+        o << ", is " << detail::ulp_distance(T(actual), expected) 
+          << " ulps away";
+    }
+  };
+
+  // Elementwise is_close of two sequences of the same length. Contiguous
+  // float or double arrays on both sides go through the vector kernel.
+  template<typename T, typename R, typename A>
+  struct IsAllClose
+  {
+    static_assert(is_container<T>::value, "expects a Container");
+
+    template<class C>
+    bool matches(const C & actual, const T & expected, const R & rtol,
+        const A & atol) const {
+      static_assert(is_container<C>::value, "expects a Container");
+
+      if constexpr (kernel<C>::value) {
+        typedef typename detail::contiguous<C>::value_type V;
+        const std::size_t n = detail::contiguous<C>::size(actual);
+        return n == detail::contiguous<T>::size(expected) &&
+          simd::find_not_close(detail::contiguous<C>::data(actual),
+            detail::contiguous<T>::data(expected), n, V(rtol), V(atol)) == n;
+      } else {
+        typedef real<C> V;
+        using std::begin;
+        using std::end;
+
+        auto a = begin(actual);
+        auto e = begin(expected);
+        for (; a != end(actual) && e != end(expected); ++a, ++e) {
+          if (!simd::is_close(V(*a), V(*e), V(rtol), V(atol)))
+            return false;
+        }
+        return a == end(actual) && e == end(expected);
+      }
+    }
+
+    void describe(writer& o, const T & expected, const R & rtol,
+        const A & atol) const {
+      o << "all close to " << expected << " with rtol " << rtol 
+        << " and atol " << atol;
+    }
+
+    template<class C>
+    void describe_mismatch(writer& o, const C & actual, const T & expected,
+        const R & rtol, const A & atol) const {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value) {
+        const auto w = worst(actual, expected, rtol, atol);
+        if (w.size != w.expected_size) {
+          o << ", has " << w.size << " elements instead of " 
+            << w.expected_size;
+        } else if (w.count != 0) {
+          typedef real<C> V;
+          o << ", " << w.count << " of " << w.size 
+            << " elements differ, worst at index " << w.index << ": " 
+            << w.a << " instead of " << w.e;
+          if (w.excess < std::numeric_limits<V>::infinity())
+            o << " (off by " << std::abs(w.a - w.e) << ", allowed " 
+              << V(atol) + V(rtol) * std::abs(w.e) << ')';
+        }
+      }
+    }
+
+    template<class C>
+    std::size_t mismatch_index(const C & actual, const T & expected,
+        const R & rtol, const A & atol) const {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value) {
+        const auto w = worst(actual, expected, rtol, atol);
+        if (w.size == w.expected_size && w.count != 0)
+          return w.index;
+      }
+      return print_limits::none;
+    }
+
+  private:
+    template<class C, class = void>
+    struct kernel : std::false_type { };
+
+    template<class C>
+    struct kernel<C, std::enable_if_t<
+        detail::contiguous<C>::value && detail::contiguous<T>::value>>
+      : std::integral_constant<bool,
+        std::is_same<typename detail::contiguous<C>::value_type,
+                     typename detail::contiguous<T>::value_type>::value &&
+        (std::is_same<typename detail::contiguous<C>::value_type, 
+                      float>::value ||
+         std::is_same<typename detail::contiguous<C>::value_type, 
+                      double>::value)>
+    { };
+
+    template<class C>
+    using real = detail::real_t<detail::element_t<C>, detail::element_t<T>>;
+
+    // The elements furthest out of tolerance, NaN and infinities first,
+    // and how many are out of it at all.
+    template<class V>
+    struct far
+    {
+      std::size_t size = 0, expected_size = 0, count = 0;
+      std::size_t index = print_limits::none;
+      V a = 0, e = 0, excess = 0;
+
+      void check(std::size_t i, V x, V y, V rtol, V atol) {
+        if (simd::is_close(x, y, rtol, atol))
+          return;
+
+        const V d = std::abs(x - y) - (atol + rtol * std::abs(y));
+        const V over = d == d ? d : std::numeric_limits<V>::infinity();
+        if (count++ == 0 || over > excess) {
+          index = i;
+          a = x;
+          e = y;
+          excess = over;
+        }
+      }
+    };
+
+    template<class C>
+    static far<real<C>> worst(const C & actual, const T & expected,
+        const R & rtol, const A & atol)
+    {
+      typedef real<C> V;
+      far<V> w;
+
+      if constexpr (kernel<C>::value) {
+        auto a = detail::contiguous<C>::data(actual);
+        auto e = detail::contiguous<T>::data(expected);
+        w.size = detail::contiguous<C>::size(actual);
+        w.expected_size = detail::contiguous<T>::size(expected);
+        if (w.size != w.expected_size)
+          return w;
+
+        // The kernel skips the runs of close elements.
+        for (std::size_t i = 0; i < w.size; ++i) {
+          i += simd::find_not_close(a + i, e + i, w.size - i, 
+            V(rtol), V(atol));
+          if (i < w.size)
+            w.check(i, a[i], e[i], V(rtol), V(atol));
+        }
+      } else {
+        using std::begin;
+        using std::end;
+
+        auto a = begin(actual);
+        auto e = begin(expected);
+        for (; a != end(actual) && e != end(expected); ++a, ++e)
+          w.check(w.size++, V(*a), V(*e), V(rtol), V(atol));
+        w.expected_size = w.size;
+        for (; a != end(actual); ++a)
+          ++w.size;
+        for (; e != end(expected); ++e)
+          ++w.expected_size;
+      }
+      return w;
+    }
+  };
+
+  namespace detail {
+
+    // One difference between two sequences: actual[a, a + n) stands where
+    // expected has [e, e + m). n or m is 0 for an insertion or deletion.
+    struct hunk
+    {
+      std::size_t a, n, e, m;
+    };
+
+    // Shortest edit script between a[0, n) and e[0, m) (Myers, "An O(ND)
+    // Difference Algorithm and Its Variations"). Each step trims the common
+    // prefix and suffix and splits the rest at the middle snake found by a
+    // forward and a reverse search, so besides the hunks it needs O(D)
+    // memory. A search that would need more than max_edits insertions and
+    // deletions gives up, which bounds the time by O((n + m) max_edits).
+    // A and E are indexed with [].
+    template<class A, class E>
+    class differ
+    {
+    public:
+      differ(A a, E e, std::size_t max_edits)
+        : a_(a)
+        , e_(e)
+        , limit_(static_cast<std::ptrdiff_t>(max_edits / 2 + 1))
+      { }
+
+      // Appends the hunks to out, or returns false if there are more
+      // edits than max_edits to find.
+      bool run(std::size_t n, std::size_t m, std::vector<hunk> & out)
+      {
+        out_ = &out;
+        return diff(0, n, 0, m);
+      }
+
+    private:
+      bool diff(std::size_t a0, std::size_t n, std::size_t e0, std::size_t m)
+      {
+        for (; n && m && a_[a0] == e_[e0]; --n, --m)
+          ++a0, ++e0;
+        for (; n && m && a_[a0 + n - 1] == e_[e0 + m - 1]; --n, --m) { }
+
+        if (n == 0 || m == 0) {
+          emit(a0, n, e0, m);
+          return true;
+        }
+
+        std::size_t x, y;
+        switch (bisect(a0, n, e0, m, x, y)) {
+        case split::found:
+          return diff(a0, x, e0, y) && diff(a0 + x, n - x, e0 + y, m - y);
+        case split::none:
+          emit(a0, n, e0, m);
+          return true;
+        default:
+          return false;
+        }
+      }
+
+      enum class split { found, none, too_far };
+
+      // Furthest-reaching paths from both corners, diagonal k holding the
+      // x reached on it; a path from the front meeting one from the back
+      // lies on a shortest edit script.
+      split bisect(std::size_t a0, std::size_t n, std::size_t e0,
+          std::size_t m, std::size_t & x, std::size_t & y)
+      {
+        typedef std::ptrdiff_t P;
+
+        const P N = static_cast<P>(n);
+        const P M = static_cast<P>(m);
+        const P full = (N + M + 1) / 2;
+        const P dmax = std::min(full, limit_);
+        const P off = dmax;
+        const P len = 2 * dmax + 2;
+        const P delta = N - M;
+        const bool front = delta % 2 != 0;
+
+        forward_.assign(static_cast<std::size_t>(len), -1);
+        reverse_.assign(static_cast<std::size_t>(len), -1);
+        forward_[off + 1] = 0;
+        reverse_[off + 1] = 0;
+
+        P k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+        for (P d = 0; d < dmax; ++d) {
+          for (P k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            const P i = off + k1;
+            P x1 = k1 == -d || (k1 != d && forward_[i - 1] < forward_[i + 1])
+              ? forward_[i + 1] : forward_[i - 1] + 1;
+            P y1 = x1 - k1;
+            while (x1 < N && y1 < M && a_[a0 + x1] == e_[e0 + y1])
+              ++x1, ++y1;
+            forward_[i] = x1;
+
+            if (x1 > N) {
+              k1end += 2;
+            } else if (y1 > M) {
+              k1start += 2;
+            } else if (front) {
+              const P j = off + delta - k1;
+              if (j >= 0 && j < len && reverse_[j] != -1 &&
+                  x1 >= N - reverse_[j]) {
+                x = static_cast<std::size_t>(x1);
+                y = static_cast<std::size_t>(y1);
+                return split::found;
+              }
+            }
+          }
+
+          for (P k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            const P i = off + k2;
+            P x2 = k2 == -d || (k2 != d && reverse_[i - 1] < reverse_[i + 1])
+              ? reverse_[i + 1] : reverse_[i - 1] + 1;
+            P y2 = x2 - k2;
+            while (x2 < N && y2 < M && 
+                a_[a0 + (N - x2 - 1)] == e_[e0 + (M - y2 - 1)])
+              ++x2, ++y2;
+            reverse_[i] = x2;
+
+            if (x2 > N) {
+              k2end += 2;
+            } else if (y2 > M) {
+              k2start += 2;
+            } else if (!front) {
+              const P j = off + delta - k2;
+              if (j >= 0 && j < len && forward_[j] != -1 &&
+                  forward_[j] >= N - x2) {
+                x = static_cast<std::size_t>(forward_[j]);
+                y = static_cast<std::size_t>(forward_[j] - (j - off));
+                return split::found;
+              }
+            }
+          }
+        }
+
+        return dmax == full ? split::none : split::too_far;
+      }
+
+      void emit(std::size_t a0, std::size_t n, std::size_t e0, std::size_t m)
+      {
+        if (n == 0 && m == 0)
+          return;
+
+        if (!out_->empty()) {
+          hunk & last = out_->back();
+          if (last.a + last.n == a0 && last.e + last.m == e0) {
+            last.n += n;
+            last.m += m;
+            return;
+          }
+        }
+        out_->push_back(hunk{a0, n, e0, m});
+      }
+
+      A a_;
+      E e_;
+      std::ptrdiff_t limit_;
+      std::vector<std::ptrdiff_t> forward_;
+      std::vector<std::ptrdiff_t> reverse_;
+      std::vector<hunk> * out_ = nullptr;
+    };
+
+    // Indexes a sequence of iterators as the elements they point at.
+    template<class Iter>
+    struct indirect
+    {
+      const Iter * iters;
+
+      decltype(auto) operator[](std::size_t i) const { return *iters[i]; }
+    };
+
+    template<class C, class = void>
+    struct is_unordered : std::false_type { };
+
+    template<class C>
+    struct is_unordered<C, std::void_t<typename C::hasher,
+      typename C::key_equal, typename C::key_type>> : std::true_type { };
+
+    template<class T, class = void>
+    struct is_hashable : std::false_type { };
+
+    template<class T>
+    struct is_hashable<T, std::void_t<decltype(
+      std::hash<T>{}(std::declval<const T &>()))>> : std::true_type { };
+
+    template<class A, class B>
+    struct is_hashable<std::pair<A,B>> : std::integral_constant<bool,
+      is_hashable<std::remove_const_t<A>>::value && 
+      is_hashable<std::remove_const_t<B>>::value> { };
+
+    template<class ... Ts>
+    struct is_hashable<std::tuple<Ts...>> : std::integral_constant<bool,
+      (is_hashable<std::remove_const_t<Ts>>::value && ...)> { };
+
+    // std::hash of V, with pairs and tuples hashed member-wise. Elements of
+    // other types are converted to V first, so that equal values hash
+    // alike.
+    template<class V>
+    struct element_hash
+    {
+      std::size_t operator()(const V & v) const { return hash(v); }
+
+      template<class A>
+      std::size_t operator()(const A & a) const { return hash(V(a)); }
+
+    private:
+      static std::size_t combine(std::size_t seed, std::size_t h) {
+        return seed ^ (h + std::size_t(0x9e3779b97f4a7c15ull) + 
+          (seed << 6) + (seed >> 2));
+      }
+
+      template<class T>
+      static std::size_t hash(const T & v) { return std::hash<T>{}(v); }
+
+      template<class A, class B>
+      static std::size_t hash(const std::pair<A,B> & v) {
+        return combine(hash(v.first), hash(v.second));
+      }
+
+      template<class ... Ts>
+      static std::size_t hash(const std::tuple<Ts...> & v) {
+        return std::apply([](const auto & ... members) {
+          std::size_t seed = 0;
+          ((seed = combine(seed, hash(members))), ...);
+          return seed;
+        }, v);
+      }
+    };
+
+    // Elements without a hash all land in one chain, which makes counting
+    // them quadratic but still correct.
+    struct no_hash
+    {
+      template<class A>
+      std::size_t operator()(const A &) const { return 0; }
+    };
+
+    // Hashes elements by their key with the hasher of the unordered
+    // container C, for comparing C with a container of another type.
+    template<class C>
+    struct key_hash
+    {
+      typename C::hasher hash;
+
+      template<class A>
+      std::size_t operator()(const A & a) const {
+        if constexpr (std::is_same<typename C::key_type, 
+            typename C::value_type>::value)
+          return hash(a);
+        else
+          return hash(a.first);
+      }
+    };
+
+    // The elements of a container with their multiplicities, in an open
+    // addressing table; take() checks off one element equal to its
+    // argument. Pointers into the container are kept, unless its iterators
+    // dereference to temporaries (proxies such as std::vector<bool>'s, or
+    // computed values), whose distinct values are copied instead.
+    template<class V, class Hash>
+    class tally
+    {
+    public:
+      template<class C>
+      tally(const C & elements, Hash hash)
+        : hash_(std::move(hash))
+      {
+        std::size_t n = 0;
+        for (auto it = std::begin(elements); it != std::end(elements); ++it)
+          ++n;
+
+        std::size_t buckets = 8;
+        while (buckets < n + n / 2)
+          buckets *= 2;
+        slots_.resize(buckets);
+        for (shift_ = 64; buckets > 1; buckets /= 2)
+          --shift_;
+
+        for (auto it = std::begin(elements); it != std::end(elements); ++it) {
+          decltype(auto) e = *it;
+          const std::size_t h = hash_(e);
+          slot & s = slots_[find(e, h)];
+          if (s.value == nullptr)
+            s = slot{keep(std::forward<decltype(e)>(e)), h, 0};
+          ++s.count;
+        }
+        left_ = n;
+      }
+
+      tally(const tally &) = delete;
+      tally & operator=(const tally &) = delete;
+
+      template<class A>
+      bool take(const A & a) {
+        slot & s = slots_[find(a, hash_(a))];
+        if (s.count == 0)
+          return false;
+        --s.count;
+        --left_;
+        return true;
+      }
+
+      // Elements not taken yet.
+      std::size_t left() const { return left_; }
+
+    private:
+      struct slot
+      {
+        const V * value = nullptr;
+        std::size_t hash = 0;
+        std::size_t count = 0;
+      };
+
+      // The slot holding a value equal to a, or the empty one it would go.
+      // std::hash is often the identity, which would put runs of
+      // consecutive keys into one probe sequence; the top bits of the hash
+      // times 2^64 / phi pick the first slot instead.
+      template<class A>
+      std::size_t find(const A & a, std::size_t h) const {
+        const std::size_t mask = slots_.size() - 1;
+        std::size_t i = static_cast<std::size_t>(
+          (h * 0x9e3779b97f4a7c15ull) >> shift_);
+        while (slots_[i].value != nullptr && 
+            !(slots_[i].hash == h && a == *slots_[i].value))
+          i = (i + 1) & mask;
+        return i;
+      }
+
+      template<class E>
+      const V * keep(E && e) {
+        if constexpr (std::is_lvalue_reference<E>::value &&
+            std::is_same<std::decay_t<E>, V>::value) {
+          return &e;
+        } else {
+          copies_.emplace_front(std::forward<E>(e));
+          return &copies_.front();
+        }
+      }
+
+      Hash hash_;
+      unsigned shift_ = 64;
+      std::vector<slot> slots_;
+      std::forward_list<V> copies_;
+      std::size_t left_ = 0;
+    };
+
+    template<class C, class = void>
+    struct has_size : std::false_type { };
+
+    template<class C>
+    struct has_size<C, std::void_t<decltype(
+      std::size(std::declval<const C &>()))>> : std::true_type { };
+
+    // Whether actual holds the elements of expected as often as expected
+    // does, in any order; actual is walked once. Containers that know
+    // their size are told apart by it before anything is hashed.
+    template<class U, class T, class Hash>
+    bool same_elements(const U & actual, const T & expected, Hash hash)
+    {
+      if constexpr (has_size<U>::value && has_size<T>::value) {
+        if (std::size(actual) != std::size(expected))
+          return false;
+      }
+
+      tally<element_t<T>, Hash> left(expected, std::move(hash));
+      for (const auto & a : actual) {
+        if (!left.take(a))
+          return false;
+      }
+      return left.left() == 0;
+    }
+
+    // Whether actual holds every element of expected, as often as expected
+    // does. Only the expected elements are hashed, and the walk over
+    // actual stops once they are all found.
+    template<class U, class T, class Hash>
+    bool includes_elements(const U & actual, const T & expected, Hash hash)
+    {
+      if constexpr (has_size<U>::value && has_size<T>::value) {
+        if (std::size(actual) < std::size(expected))
+          return false;
+      }
+
+      tally<element_t<T>, Hash> left(expected, std::move(hash));
+      for (auto it = std::begin(actual); 
+          left.left() != 0 && it != std::end(actual); ++it)
+        left.take(*it);
+      return left.left() == 0;
+    }
+
+    // Lists the elements of actual that expected does not account for,
+    // unless only missing ones matter, and those of expected left over,
+    // each in its container's order.
+    template<class U, class T, class Hash>
+    void describe_unmatched(writer& o, const U & actual, const T & expected,
+        Hash hash, bool extras = true)
+    {
+      tally<element_t<T>, Hash> left(expected, hash);
+      const std::size_t max = o.limits().max_elements;
+
+      std::size_t extra = 0;
+      for (const auto & a : actual) {
+        if (left.take(a) || !extras)
+          continue;
+        if (extra < max)
+          o << (extra ? ", " : ", has extra [") << a;
+        ++extra;
+      }
+      if (extra)
+        o << (extra > max ? ", ...]" : "]");
+
+      if (left.left() == 0)
+        return;
+
+      // Taking the expected elements again in order finds those still
+      // counted, earliest duplicates first.
+      std::size_t missing = 0;
+      o << (extra ? " and is missing [" : ", is missing [");
+      for (const auto & e : expected) {
+        if (!left.take(e))
+          continue;
+        if (missing == max) {
+          o << ", ...";
+          break;
+        }
+        o << (missing++ ? ", " : "") << e;
+      }
+      o << ']';
+    }
+
+    // How an order-insensitive comparison of U and T hashes elements:
+    // with the hasher of whichever is an unordered container, else with
+    // std::hash when the elements have one.
+    template<class U, class T>
+    auto unordered_hash(const U & actual, const T & expected)
+    {
+      if constexpr (is_unordered<T>::value)
+        return key_hash<T>{expected.hash_function()};
+      else if constexpr (is_unordered<U>::value)
+        return key_hash<U>{actual.hash_function()};
+      else if constexpr (is_hashable<element_t<T>>::value)
+        return element_hash<element_t<T>>{};
+      else
+        return no_hash{};
+    }
+
+  }; // end detail
+
+  template <typename T>
+  struct IsEqual<T, std::enable_if_t<is_container<T>::value>> 
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      using std::begin;
+      using std::end;
+
+      if constexpr (unordered<U>::value) {
+        if constexpr (std::is_same<U, T>::value)
+          return actual == expected;
+        else
+          return detail::same_elements(actual, expected,
+            detail::unordered_hash(actual, expected));
+      } else if constexpr (bitwise<U>::value) {
+        const std::size_t n = detail::contiguous<U>::size(actual);
+        return n == detail::contiguous<T>::size(expected) &&
+          simd::mismatch(detail::contiguous<U>::data(actual),
+                         detail::contiguous<T>::data(expected), n) == n;
+      }
+
+      return detail::equal(begin(actual),   end(actual),
+                           begin(expected), end(expected));
+    }
+
+    void describe(writer& o, T const& expected) const {
+       o << "equal " << expected;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, 
+        const T & expected) const {
+      using std::begin;
+      using std::end;
+
+      if constexpr (unordered<U>::value) {
+        if constexpr (is_multipass<decltype(begin(actual))>::value)
+          detail::describe_unmatched(o, actual, expected,
+            detail::unordered_hash(actual, expected));
+      } else if constexpr (bitwise<U>::value) {
+        auto a = detail::contiguous<U>::data(actual);
+        auto e = detail::contiguous<T>::data(expected);
+        const std::size_t n = detail::contiguous<U>::size(actual);
+        const std::size_t m = detail::contiguous<T>::size(expected);
+        const std::size_t i = simd::mismatch(a, e, std::min(n, m));
+
+        describe_edits(o, i, a + i, n - i, e + i, m - i);
+      } else if constexpr (detail::is_random_access<U>::value &&
+          detail::is_random_access<T>::value) {
+        const std::size_t i = mismatch_index(actual, expected);
+        const auto n = static_cast<std::size_t>(end(actual) - begin(actual));
+        const auto m = 
+          static_cast<std::size_t>(end(expected) - begin(expected));
+
+        describe_edits(o, i, std::next(begin(actual), i), n - i,
+          std::next(begin(expected), i), m - i);
+      } else if constexpr (is_multipass<decltype(begin(actual))>::value) {
+        auto a = begin(actual);
+        auto e = begin(expected);
+        std::size_t i = 0;
+        for (; a != end(actual) && e != end(expected) && *a == *e; ++a, ++e)
+          ++i;
+
+        // Iterators to the rest of both sides index it for the differ, as
+        // long as neither has more than max_window elements left.
+        std::vector<decltype(a)> as;
+        std::vector<decltype(e)> es;
+        for (; a != end(actual) && as.size() <= max_window; ++a)
+          as.push_back(a);
+        for (; e != end(expected) && es.size() <= max_window; ++e)
+          es.push_back(e);
+
+        if (as.size() > max_window || es.size() > max_window) {
+          o << ", first mismatch at index " << i << ": ";
+          if (as.empty())
+            o << "missing " << *es[0];
+          else if (es.empty())
+            o << "extra " << *as[0];
+          else
+            o << *as[0] << " instead of " << *es[0];
+          o << ", with more than " << max_window << " elements after it";
+          return;
+        }
+
+        describe_edits(o, i, detail::indirect<decltype(a)>{as.data()},
+          as.size(), detail::indirect<decltype(e)>{es.data()}, es.size());
+      }
+    }
+
+    template<typename U>
+    std::size_t mismatch_index(const U & actual, const T & expected) const {
+      using std::begin;
+      using std::end;
+
+      if constexpr (unordered<U>::value) {
+        return print_limits::none;
+      } else if constexpr (bitwise<U>::value) {
+        const std::size_t n = detail::contiguous<U>::size(actual);
+        const std::size_t m = detail::contiguous<T>::size(expected);
+        return simd::mismatch(detail::contiguous<U>::data(actual),
+          detail::contiguous<T>::data(expected), std::min(n, m));
+      } else if constexpr (is_multipass<decltype(begin(actual))>::value) {
+        auto a = begin(actual);
+        auto e = begin(expected);
+        std::size_t i = 0;
+        for (; a != end(actual) && e != end(expected) && *a == *e; ++a, ++e)
+          ++i;
+        return i;
+      } else {
+        return print_limits::none;
+      }
+    }
+
+  private:
+    // Either side iterating in hash order makes the order meaningless;
+    // such containers compare as multisets.
+    template<typename U>
+    struct unordered : std::integral_constant<bool,
+      detail::is_unordered<U>::value || detail::is_unordered<T>::value> { };
+
+    // Flat element arrays on both sides whose == compares bytes.
+    template<typename U, class = void>
+    struct bitwise : std::false_type { };
+
+    template<typename U>
+    struct bitwise<U, std::enable_if_t<
+        detail::contiguous<U>::value && detail::contiguous<T>::value>>
+      : std::integral_constant<bool,
+        std::is_same<typename detail::contiguous<U>::value_type,
+                     typename detail::contiguous<T>::value_type>::value &&
+        detail::is_bitwise_comparable<
+          typename detail::contiguous<U>::value_type>::value>
+    { };
+
+    // Edits past which a mismatch is reported by its first difference.
+    static constexpr std::size_t max_edits = 128;
+
+    // Elements after the first difference past which sequences without
+    // random access are reported by it alone.
+    static constexpr std::size_t max_window = 4 * max_edits;
+
+    // Lists the hunks turning actual into expected, a and e starting at
+    // index first, as long as the writer's element limit allows.
+    template<class A, class E>
+    static void describe_edits(writer& o, std::size_t first, 
+        A a, std::size_t n, E e, std::size_t m)
+    {
+      std::vector<detail::hunk> hunks;
+
+      if (!detail::differ<A,E>(a, e, max_edits).run(n, m, hunks)) {
+        o << ", first mismatch at index " << first << ": "
+          << a[0] << " instead of " << e[0] 
+          << ", and more than " << max_edits << " edits in all";
+        return;
+      }
+
+      const std::size_t max = o.limits().max_elements;
+      std::size_t shown = 0;
+
+      for (std::size_t k = 0; k < hunks.size(); ++k) {
+        const detail::hunk & h = hunks[k];
+        if (shown >= max) {
+          o << "; and " << hunks.size() - k << " more";
+          return;
+        }
+
+        o << (k ? "; at index " : ", differs at index ") << first + h.a 
+          << ": ";
+        if (h.n == 1 && h.m == 1) {
+          o << a[h.a] << " instead of " << e[h.e];
+        } else if (h.m == 0) {
+          o << "extra ";
+          describe_elements(o, a, h.a, h.n, max);
+        } else if (h.n == 0) {
+          o << "missing ";
+          describe_elements(o, e, h.e, h.m, max);
+        } else {
+          describe_elements(o, a, h.a, h.n, max);
+          o << " instead of ";
+          describe_elements(o, e, h.e, h.m, max);
+        }
+        shown += h.n + h.m;
+      }
+    }
+
+    template<class S>
+    static void describe_elements(writer& o, S s, std::size_t first,
+        std::size_t count, std::size_t max)
+    {
+      o << '[';
+      for (std::size_t i = 0; i < count && i < max; ++i)
+        o << (i ? ", " : "") << s[first + i];
+      if (count > max)
+        o << ", ...";
+      o << ']';
+    }
+  };
+
+  // Sequences holding the same elements as often, in any order. Elements
+  // are counted in a hash table, so the comparison is linear.
+  template<typename T>
+  struct IsEqualIgnoringOrder
+  {
+    static_assert(is_container<T>::value, "expects a Container");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      return detail::same_elements(actual, expected,
+        detail::unordered_hash(actual, expected));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "equal ignoring order " << expected;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, 
+        const T & expected) const {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value)
+        detail::describe_unmatched(o, actual, expected,
+          detail::unordered_hash(actual, expected));
+    }
+  };
+
+  template<class...> struct IsContaining;
+
+  template<class T>
+  struct IsContaining<T>
+  {
+    template<class C>
+    bool matches(const C & actual, const T & expected) const
+    {
+      static_assert(is_container<C>::value, "expects a Container");
+
+      if constexpr (searchable<C>::value) {
+        typedef detail::contiguous<C> storage;
+        typedef typename storage::value_type E;
+
+        // Searching for E(expected) is the same as comparing every element
+        // with expected, unless the conversion changed its value, in which
+        // case no element can compare equal.
+        typedef std::common_type_t<E, T> common;
+        const E needle = static_cast<E>(expected);
+        if (!(static_cast<common>(needle) == static_cast<common>(expected)))
+          return false;
+
+        const std::size_t n = storage::size(actual);
+        return simd::find(storage::data(actual), n, needle) != n;
+      } else {
+        using std::begin;
+        using std::end;
+
+        return detail::contains(begin(actual), end(actual), expected);
+      }
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "contain " << expected;
+    }
+
+  private:
+    template<class C, class = void>
+    struct searchable : std::false_type { };
+
+    template<class C>
+    struct searchable<C, std::enable_if_t<detail::contiguous<C>::value>>
+      : std::integral_constant<bool,
+        simd::is_vectorizable<
+          typename detail::contiguous<C>::value_type>::value &&
+        std::is_arithmetic<T>::value &&
+        (std::is_integral<T>::value || std::is_floating_point<
+          typename detail::contiguous<C>::value_type>::value)>
+    { };
+  };
+
+  namespace detail {
+
+    template<class C, class = void>
+    struct is_associative : std::false_type { };
+
+    template<class C>
+    struct is_associative<C, std::void_t<typename C::key_type,
+      typename C::mapped_type, decltype(std::declval<const C &>().equal_range(
+        std::declval<const typename C::key_type &>()))>>
+      : std::true_type { };
+
+    // multimap and unordered_multimap return an iterator from insert, the
+    // unique-key containers a pair<iterator, bool>.
+    template<class C>
+    struct has_unique_keys : std::integral_constant<bool,
+      !std::is_same<typename C::iterator, decltype(std::declval<C &>().insert(
+        std::declval<const typename C::value_type &>()))>::value>
+    { };
+
+    template<class C, class = void>
+    struct has_transparent_lookup : std::false_type { };
+
+    template<class C>
+    struct has_transparent_lookup<C,
+      std::void_t<typename C::key_compare::is_transparent>>
+      : std::true_type { };
+
+    template<class C>
+    struct has_transparent_lookup<C,
+      std::void_t<typename C::hasher::is_transparent, 
+                  typename C::key_equal::is_transparent>>
+      : std::true_type { };
+
+    // Keys are handed to the container's own lookup as they are when they
+    // have its key_type or the container supports heterogeneous lookup;
+    // anything else is converted to key_type once.
+    template<class C, class Key, class F>
+    decltype(auto) with_lookup_key(const Key & key, F && f)
+    {
+      if constexpr (std::is_same<Key, typename C::key_type>::value ||
+          has_transparent_lookup<C>::value)
+        return f(key);
+      else
+        return f(static_cast<const typename C::key_type &>(
+          typename C::key_type(key)));
+    }
+
+    // Iterators to the entries of c stored under key.
+    template<class C, class Key>
+    auto equal_range(const C & c, const Key & key)
+    {
+      return with_lookup_key<C>(key, [&c](const auto & k) {
+        if constexpr (has_unique_keys<C>::value) {
+          auto found = c.find(k);
+          auto last = found;
+          return std::make_pair(found, found == c.end() ? last : ++last);
+        } else {
+          return c.equal_range(k);
+        }
+      });
+    }
+
+    // String literal and C string keys are stored as std::string, which
+    // string-keyed containers look up without a temporary per call.
+    template<class Key>
+    decltype(auto) lookup_key(Key && key)
+    {
+      typedef std::decay_t<Key> type;
+      if constexpr (std::is_same<type, const char *>::value ||
+          std::is_same<type, char *>::value)
+        return std::string(key);
+      else
+        return std::forward<Key>(key);
+    }
+
+  }; // end detail
+
+  template<class Key, class T>
+  struct IsContaining<Key,T>
+  {
+    template<class C>
+    bool matches(const C & actual, const Key & key, const T & value) const
+    {
+      static_assert(is_container<C>::value, "expects a Container");
+
+      if constexpr (detail::is_associative<C>::value) {
+        auto found = detail::equal_range(actual, key);
+        for (auto it = found.first; it != found.second; ++it) {
+          if (it->second == value)
+            return true;
+        }
+        return false;
+      } else {
+        for (const auto & entry : actual) {
+          if (entry.first == key && entry.second == value)
+            return true;
+        }
+        return false;
+      }
+    }
+
+    void describe(writer& o, const Key & key, const T & value) const {
+      o << "contain key " << key << " and value " <<  value;
+    }
+
+    template<class C>
+    void describe_mismatch(writer& o, const C & actual, const Key & key,
+        const T &) const {
+      if constexpr (detail::is_associative<C>::value) {
+        auto found = detail::equal_range(actual, key);
+        if (found.first == found.second) {
+          o << ", but has no key " << key;
+          return;
+        }
+
+        o << ", but key " << key << " maps to ";
+        if constexpr (detail::has_unique_keys<C>::value) {
+          o << found.first->second;
+        } else {
+          const char * delim = "[";
+          for (auto it = found.first; it != found.second; ++it) {
+            o << delim << it->second;
+            delim = ", ";
+          }
+          o << ']';
+        }
+      }
+    }
+
+  };
+
+  // Exactly the given elements, as often as they are given, in any order.
+  template<typename T>
+  struct IsContainingInAnyOrder
+  {
+    template<class C>
+    bool matches(const C & actual, const T & expected) const {
+      static_assert(is_container<C>::value, "expects a Container");
+
+      return detail::same_elements(actual, expected,
+        detail::unordered_hash(actual, expected));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "contain in any order " << expected;
+    }
+
+    template<class C>
+    void describe_mismatch(writer& o, const C & actual, 
+        const T & expected) const {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value)
+        detail::describe_unmatched(o, actual, expected,
+          detail::unordered_hash(actual, expected));
+    }
+  };
+
+  // Every element of a container, as often as it occurs there, among
+  // others in any order.
+  template<typename T>
+  struct IsContainingAll
+  {
+    static_assert(is_container<T>::value, "expects a Container");
+
+    template<class C>
+    bool matches(const C & actual, const T & expected) const {
+      static_assert(is_container<C>::value, "expects a Container");
+
+      return detail::includes_elements(actual, expected,
+        detail::unordered_hash(actual, expected));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "contain all of " << expected;
+    }
+
+    template<class C>
+    void describe_mismatch(writer& o, const C & actual, 
+        const T & expected) const {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value)
+        detail::describe_unmatched(o, actual, expected,
+          detail::unordered_hash(actual, expected), false);
+    }
+  };
+
+  namespace detail {
+
+    // Characters stored contiguously: C strings, char arrays (up to the
+    // first NUL), std::string, std::string_view and char containers.
+    template<class T, class = void>
+    struct is_string_like : std::false_type { };
+
+    template<>
+    struct is_string_like<const char *> : std::true_type { };
+
+    template<>
+    struct is_string_like<char *> : std::true_type { };
+
+    template<std::size_t N>
+    struct is_string_like<char[N]> : std::true_type { };
+
+    template<class T>
+    struct is_string_like<T, std::enable_if_t<std::is_same<
+      std::remove_const_t<std::remove_pointer_t<decltype(
+        std::declval<const T &>().data())>>, char>::value &&
+      std::is_integral<decltype(std::declval<const T &>().size())>::value>>
+      : std::true_type { };
+
+    inline std::string_view as_string_view(const char * s) {
+      return s != nullptr ? std::string_view(s) : std::string_view();
+    }
+
+    template<std::size_t N>
+    std::string_view as_string_view(const char (&s)[N]) {
+      const void * nul = std::memchr(s, '\0', N);
+      return std::string_view(s, nul != nullptr 
+        ? static_cast<std::size_t>(static_cast<const char *>(nul) - s) : N);
+    }
+
+    template<class T, class = std::enable_if_t<!std::is_pointer<T>::value &&
+      !std::is_array<T>::value>>
+    std::string_view as_string_view(const T & s) {
+      return std::string_view(s.data(), s.size());
+    }
+
+  }; // end detail
+
+  // Char arrays, usually string literals, compare by their characters up
+  // to the first NUL rather than by address; other arrays are containers.
+  template<std::size_t N>
+  struct IsEqual<char[N]>
+  {
+    template<typename U>
+    bool matches(const U & actual, const char (&expected)[N]) const {
+      static_assert(detail::is_string_like<U>::value, "expects a string");
+
+      return detail::as_string_view(actual) ==
+        detail::as_string_view(expected);
+    }
+
+    void describe(writer& o, const char (&expected)[N]) const {
+       o << "equal " << expected;
+    }
+  };
+
+  template<typename T>
+  struct StartsWith
+  {
+    static_assert(detail::is_string_like<T>::value, "expects a string");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      static_assert(detail::is_string_like<U>::value, "expects a string");
+
+      std::string_view a = detail::as_string_view(actual);
+      std::string_view e = detail::as_string_view(expected);
+      return a.size() >= e.size() &&
+        std::memcmp(a.data(), e.data(), e.size()) == 0;
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "start with " << expected;
+    }
+  };
+
+  template<typename T>
+  struct EndsWith
+  {
+    static_assert(detail::is_string_like<T>::value, "expects a string");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      static_assert(detail::is_string_like<U>::value, "expects a string");
+
+      std::string_view a = detail::as_string_view(actual);
+      std::string_view e = detail::as_string_view(expected);
+      return a.size() >= e.size() &&
+        std::memcmp(a.data() + a.size() - e.size(), e.data(), e.size()) == 0;
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "end with " << expected;
+    }
+  };
+
+  template<typename T>
+  struct ContainsSubstring
+  {
+    static_assert(detail::is_string_like<T>::value, "expects a string");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      static_assert(detail::is_string_like<U>::value, "expects a string");
+
+      return simd::search(detail::as_string_view(actual),
+        detail::as_string_view(expected)) != std::string_view::npos;
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "contain substring " << expected;
+    }
+  };
+
+  // A regular expression compiled into a Thompson NFA, matched through a
+  // DFA whose states are built lazily on first use and then cached, so a
+  // pattern that is reused costs one table lookup per input byte. The cache
+  // holds at most max_states states; inputs that need more fall back to
+  // stepping NFA state sets for their remainder, still without allocating.
+  //
+  // matches() may be called from several threads at once. Built transitions
+  // are read without locking; building one takes a lock, and the NFA sets
+  // are stepped in per-thread scratch space. Copies share the cache.
+  //
+  // Supported: literals, ., [...] and [^...] classes, \d \D \w \W \s \S,
+  // \n \t \r \f \v \0 \xHH, escaped metacharacters, ( ) and (?: ), |,
+  // * + ? {m} {m,} {m,n} (lazy variants match the same strings), ^ and $.
+  // The whole input has to match, as with std::regex_match; bytes are
+  // matched one at a time, so UTF-8 text is matched as bytes. Groups and
+  // stacked quantifiers nest at most 256 deep.
+  class pattern
+  {
+  public:
+    explicit pattern(std::string_view source, std::size_t max_states = 4096);
+
+    bool matches(std::string_view input) const;
+
+    const std::string & source() const { return source_; }
+
+  private:
+    typedef std::bitset<256> byte_set;
+
+    struct nfa_state
+    {
+      enum op_type : unsigned char { bytes, split, jump, bol, eol, accept };
+
+      op_type op;
+      int out;
+      int out1;
+      int set;
+    };
+
+    // Transitions live in blocks of rows that are allocated as states are
+    // added and never move, so a row can be read while another is built.
+    // A state is published by the release store of the cell leading to it,
+    // after its row and accepting flag are in place.
+    struct dfa_cache
+    {
+      static constexpr std::size_t block_rows = 64;
+
+      dfa_cache(std::size_t max_states, std::size_t width)
+        : width(width)
+        , blocks((max_states + block_rows - 1) / block_rows)
+        , accepting(new bool[max_states]())
+      { }
+
+      std::atomic<int> & cell(int state, std::size_t cls) {
+        auto row = static_cast<std::size_t>(state);
+        return blocks[row / block_rows][(row % block_rows) * width + cls];
+      }
+
+      const std::size_t width;
+      std::vector<std::unique_ptr<std::atomic<int>[]>> blocks;
+      std::unique_ptr<bool[]> accepting;
+
+      // Only used under mutex.
+      std::mutex mutex;
+      std::vector<std::vector<int>> sets;
+      std::map<std::vector<int>, int> index;
+    };
+
+    struct scratch
+    {
+      std::vector<int> stack;
+      std::vector<int> current;
+      std::vector<int> next;
+      std::vector<unsigned> marks;
+      unsigned generation = 0;
+    };
+
+    struct ast
+    {
+      enum kind_type { empty, bytes, concat, alternate, repeat, bol, eol };
+
+      kind_type kind;
+      std::vector<int> children;
+      int set;
+      int min;
+      int max;
+    };
+
+    class parser;
+
+    static constexpr int dead = 0;
+    static constexpr std::size_t max_nfa_states = 1 << 16;
+
+    int add_state(nfa_state::op_type op, int out = -1, int out1 = -1, 
+        int set = -1);
+    int compile(const std::vector<ast> & tree, int node, int next);
+    void compute_byte_classes();
+
+    scratch & local_scratch() const;
+    static void next_generation(scratch & s);
+    void closure(bool at_start, std::vector<int> & out, scratch & s) const;
+    void step(const std::vector<int> & from, unsigned char byte,
+        std::vector<int> & out, scratch & s) const;
+    bool accepts(const std::vector<int> & set, scratch & s) const;
+    int add_dfa_state(const std::vector<int> & set, scratch & s) const;
+    int transition(int state, unsigned char byte, scratch & s) const;
+    bool simulate(int state, std::string_view rest, scratch & s) const;
+
+    std::string source_;
+    std::size_t max_states_;
+
+    std::vector<nfa_state> nfa_;
+    std::vector<byte_set> sets_;
+
+    std::array<unsigned char, 256> classes_;
+    std::size_t nclasses_ = 0;
+
+    std::shared_ptr<dfa_cache> cache_;
+    int start_ = dead;
+  };
+
+  class pattern::parser
+  {
+  public:
+    parser(std::string_view source, std::vector<ast> & tree,
+        std::vector<byte_set> & sets)
+      : src_(source)
+      , tree_(tree)
+      , sets_(sets)
+    { }
+
+    int parse()
+    {
+      int root = alternation();
+      if (pos_ != src_.size())
+        error("unmatched )");
+      return root;
+    }
+
+  private:
+    [[noreturn]] void error(const char * what) const
+    {
+      throw std::invalid_argument("matchesRegex: " + std::string(what) +
+        " at offset " + std::to_string(pos_) + " in \"" + 
+        std::string(src_) + '"');
+    }
+
+    bool at(char c) const { return pos_ < src_.size() && src_[pos_] == c; }
+
+    // Nodes are compiled recursively, so the tree is kept shallow enough
+    // for the stack; heights_ parallels tree_.
+    int add(ast::kind_type kind, std::vector<int> children = {},
+        int set = -1, int min = 0, int max = 0)
+    {
+      int height = 1;
+      for (int child : children)
+        height = std::max(height, heights_[static_cast<std::size_t>(child)] 
+          + 1);
+      if (height > max_nesting)
+        error("pattern nested too deeply");
+
+      tree_.push_back(ast{kind, std::move(children), set, min, max});
+      heights_.push_back(height);
+      return static_cast<int>(tree_.size() - 1);
+    }
+
+    int add_set(const byte_set & set)
+    {
+      sets_.push_back(set);
+      return add(ast::bytes, {}, static_cast<int>(sets_.size() - 1));
+    }
+
+    int alternation()
+    {
+      std::vector<int> alternatives{concatenation()};
+      while (at('|')) {
+        ++pos_;
+        alternatives.push_back(concatenation());
+      }
+      if (alternatives.size() == 1)
+        return alternatives.front();
+      return add(ast::alternate, std::move(alternatives));
+    }
+
+    int concatenation()
+    {
+      std::vector<int> items;
+      while (pos_ < src_.size() && !at('|') && !at(')'))
+        items.push_back(repetition());
+
+      if (items.empty())
+        return add(ast::empty);
+      if (items.size() == 1)
+        return items.front();
+      return add(ast::concat, std::move(items));
+    }
+
+    int repetition()
+    {
+      int node = atom();
+
+      for (;;) {
+        int min, max;
+        if (at('*')) {
+          ++pos_, min = 0, max = -1;
+        } else if (at('+')) {
+          ++pos_, min = 1, max = -1;
+        } else if (at('?')) {
+          ++pos_, min = 0, max = 1;
+        } else if (!bounds(min, max)) {
+          return node;
+        }
+
+        if (at('?'))
+          ++pos_;
+        node = add(ast::repeat, {node}, -1, min, max);
+      }
+    }
+
+    // {m}, {m,} or {m,n}; anything else starting with { is a literal.
+    bool bounds(int & min, int & max)
+    {
+      if (!at('{'))
+        return false;
+
+      std::size_t p = pos_ + 1;
+      auto number = [&](int & value) {
+        std::size_t first = p;
+        value = 0;
+        for (; p < src_.size() && src_[p] >= '0' && src_[p] <= '9'; ++p) {
+          value = value * 10 + (src_[p] - '0');
+          if (value > 1000)
+            error("repetition count too large");
+        }
+        return p != first;
+      };
+
+      if (!number(min))
+        return false;
+      max = min;
+      if (p < src_.size() && src_[p] == ',') {
+        ++p;
+        if (!number(max))
+          max = -1;
+      }
+      if (p >= src_.size() || src_[p] != '}')
+        return false;
+      if (max != -1 && max < min)
+        error("repetition range out of order");
+
+      pos_ = p + 1;
+      return true;
+    }
+
+    int atom()
+    {
+      char c = src_[pos_++];
+      switch (c) {
+        case '(':
+          if (src_.substr(pos_, 2) == "?:")
+            pos_ += 2;
+          else if (at('?'))
+            error("unsupported group");
+          if (++groups_ > max_nesting)
+            error("pattern nested too deeply");
+          {
+            int node = alternation();
+            if (!at(')'))
+              error("missing )");
+            ++pos_;
+            --groups_;
+            return node;
+          }
+        case ')':
+          error("unmatched )");
+        case '*': case '+': case '?':
+          --pos_;
+          error("nothing to repeat");
+        case '[':
+          return add_set(bracket());
+        case '.': {
+          byte_set any;
+          any.set();
+          any.reset('\n');
+          return add_set(any);
+        }
+        case '^':
+          return add(ast::bol);
+        case '$':
+          return add(ast::eol);
+        case '\\': {
+          byte_set set;
+          escape(set, false);
+          return add_set(set);
+        }
+        default: {
+          byte_set set;
+          set.set(static_cast<unsigned char>(c));
+          return add_set(set);
+        }
+      }
+    }
+
+    static void add_range(byte_set & set, int first, int last)
+    {
+      for (int b = first; b <= last; ++b)
+        set.set(static_cast<std::size_t>(b));
+    }
+
+    static byte_set word()
+    {
+      byte_set set;
+      add_range(set, 'a', 'z');
+      add_range(set, 'A', 'Z');
+      add_range(set, '0', '9');
+      set.set('_');
+      return set;
+    }
+
+    static byte_set space()
+    {
+      byte_set set;
+      for (char c : {' ', '\t', '\n', '\r', '\f', '\v'})
+        set.set(static_cast<unsigned char>(c));
+      return set;
+    }
+
+    static byte_set digit()
+    {
+      byte_set set;
+      add_range(set, '0', '9');
+      return set;
+    }
+
+    // Adds the escape following a backslash to set. Returns the byte for
+    // single-byte escapes, or -1 for classes such as \d.
+    int escape(byte_set & set, bool in_bracket)
+    {
+      if (pos_ >= src_.size())
+        error("trailing backslash");
+
+      char c = src_[pos_++];
+      int byte = -1;
+      switch (c) {
+        case 'd': set |= digit(); break;
+        case 'D': set |= ~digit(); break;
+        case 'w': set |= word(); break;
+        case 'W': set |= ~word(); break;
+        case 's': set |= space(); break;
+        case 'S': set |= ~space(); break;
+        case 'n': byte = '\n'; break;
+        case 't': byte = '\t'; break;
+        case 'r': byte = '\r'; break;
+        case 'f': byte = '\f'; break;
+        case 'v': byte = '\v'; break;
+        case '0': byte = 0; break;
+        case 'b':
+          if (!in_bracket)
+            error("word boundaries are not supported");
+          byte = '\b';
+          break;
+        case 'x': {
+          auto hex = [this](std::size_t p) {
+            char h = p < src_.size() ? src_[p] : '\0';
+            if (h >= '0' && h <= '9') return h - '0';
+            if (h >= 'a' && h <= 'f') return h - 'a' + 10;
+            if (h >= 'A' && h <= 'F') return h - 'A' + 10;
+            error("invalid \\x escape");
+          };
+          byte = hex(pos_) * 16 + hex(pos_ + 1);
+          pos_ += 2;
+          break;
+        }
+        default:
+          if (c >= '1' && c <= '9')
+            error("backreferences are not supported");
+          if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+            error("unknown escape");
+          byte = static_cast<unsigned char>(c);
+      }
+
+      if (byte >= 0)
+        set.set(static_cast<std::size_t>(byte));
+      return byte;
+    }
+
+    byte_set bracket()
+    {
+      byte_set set;
+      bool negate = at('^');
+      if (negate)
+        ++pos_;
+
+      for (bool first = true; ; first = false) {
+        if (pos_ >= src_.size())
+          error("missing ]");
+        if (at(']') && !first)
+          break;
+
+        int low;
+        if (at('\\')) {
+          ++pos_;
+          low = escape(set, true);
+          if (low < 0)
+            continue;
+        } else {
+          low = static_cast<unsigned char>(src_[pos_++]);
+          set.set(static_cast<std::size_t>(low));
+        }
+
+        if (at('-') && pos_ + 1 < src_.size() && src_[pos_ + 1] != ']') {
+          ++pos_;
+          int high;
+          if (at('\\')) {
+            ++pos_;
+            byte_set ignored;
+            high = escape(ignored, true);
+            if (high < 0)
+              error("invalid class range");
+          } else {
+            high = static_cast<unsigned char>(src_[pos_++]);
+          }
+          if (high < low)
+            error("class range out of order");
+          add_range(set, low, high);
+        }
+      }
+      ++pos_;
+
+      if (negate)
+        set.flip();
+      return set;
+    }
+
+    static constexpr int max_nesting = 256;
+
+    std::string_view src_;
+    std::size_t pos_ = 0;
+    std::vector<ast> & tree_;
+    std::vector<byte_set> & sets_;
+    std::vector<int> heights_;
+    int groups_ = 0;
+  };
+
+  inline pattern::pattern(std::string_view source, std::size_t max_states)
+    : source_(source)
+    , max_states_(std::max<std::size_t>(max_states, 2))
+  {
+    std::vector<ast> tree;
+    int root = parser(source_, tree, sets_).parse();
+
+    int accept = add_state(nfa_state::accept);
+    int start = compile(tree, root, accept);
+
+    compute_byte_classes();
+    cache_ = std::make_shared<dfa_cache>(max_states_, nclasses_);
+
+    scratch & s = local_scratch();
+    add_dfa_state({}, s);
+    s.stack.push_back(start);
+    closure(true, s.next, s);
+
+    auto found = cache_->index.find(s.next);
+    start_ = found != cache_->index.end() ? found->second :
+      add_dfa_state(s.next, s);
+  }
+
+  inline int pattern::add_state(nfa_state::op_type op, int out, int out1,
+      int set)
+  {
+    if (nfa_.size() >= max_nfa_states)
+      throw std::invalid_argument("matchesRegex: pattern too large \"" +
+        source_ + '"');
+
+    nfa_.push_back(nfa_state{op, out, out1, set});
+    return static_cast<int>(nfa_.size() - 1);
+  }
+
+  // Compiles node so that it continues to next, returning its entry state.
+  inline int pattern::compile(const std::vector<ast> & tree, int node,
+      int next)
+  {
+    const ast & n = tree[static_cast<std::size_t>(node)];
+
+    switch (n.kind) {
+      case ast::empty:
+        return next;
+      case ast::bytes:
+        return add_state(nfa_state::bytes, next, -1, n.set);
+      case ast::bol:
+        return add_state(nfa_state::bol, next);
+      case ast::eol:
+        return add_state(nfa_state::eol, next);
+      case ast::concat:
+        for (auto it = n.children.rbegin(); it != n.children.rend(); ++it)
+          next = compile(tree, *it, next);
+        return next;
+      case ast::alternate: {
+        int entry = compile(tree, n.children.back(), next);
+        for (std::size_t i = n.children.size() - 1; i-- > 0; ) {
+          int branch = compile(tree, n.children[i], next);
+          entry = add_state(nfa_state::split, branch, entry);
+        }
+        return entry;
+      }
+      case ast::repeat: {
+        int child = n.children.front();
+        int entry = next;
+        if (n.max < 0) {
+          int loop = add_state(nfa_state::split, -1, next);
+          nfa_[static_cast<std::size_t>(loop)].out = compile(tree, child, loop);
+          entry = loop;
+        } else {
+          // x{0,k} is (x(x(...)?)?)?
+          for (int i = n.min; i < n.max; ++i) {
+            int body = compile(tree, child, entry);
+            entry = add_state(nfa_state::split, body, next);
+          }
+        }
+        for (int i = 0; i < n.min; ++i)
+          entry = compile(tree, child, entry);
+        return entry;
+      }
+    }
+    return next;
+  }
+
+  // Bytes that no set tells apart share a class, which keeps the DFA
+  // transition table narrow.
+  inline void pattern::compute_byte_classes()
+  {
+    classes_.fill(0);
+    nclasses_ = 1;
+
+    for (const byte_set & set : sets_) {
+      std::array<int, 512> renumber;
+      renumber.fill(-1);
+      std::size_t count = 0;
+
+      for (std::size_t b = 0; b < 256; ++b) {
+        int & id = renumber[classes_[b] * 2 + (set[b] ? 1 : 0)];
+        if (id < 0)
+          id = static_cast<int>(count++);
+        classes_[b] = static_cast<unsigned char>(id);
+      }
+      nclasses_ = count;
+    }
+  }
+
+  // Scratch space of the calling thread, shared by all patterns and sized
+  // for the largest NFA seen so far.
+  inline pattern::scratch & pattern::local_scratch() const
+  {
+    static thread_local scratch s;
+
+    if (s.marks.size() < nfa_.size()) {
+      s.marks.assign(nfa_.size(), 0u);
+      s.generation = 0;
+      s.stack.reserve(3 * nfa_.size() + 1);
+      s.current.reserve(nfa_.size());
+      s.next.reserve(nfa_.size());
+    }
+    return s;
+  }
+
+  inline void pattern::next_generation(scratch & s)
+  {
+    if (++s.generation == 0) {
+      std::fill(s.marks.begin(), s.marks.end(), 0u);
+      s.generation = 1;
+    }
+  }
+
+  // Expands the states on the scratch stack through split, jump and (at the
+  // start of the input) ^ states into out, sorted. $ states are kept in the
+  // set and only passed by accepts().
+  inline void pattern::closure(bool at_start, std::vector<int> & out,
+      scratch & s) const
+  {
+    next_generation(s);
+
+    out.clear();
+    while (!s.stack.empty()) {
+      int id = s.stack.back();
+      s.stack.pop_back();
+
+      unsigned & mark = s.marks[static_cast<std::size_t>(id)];
+      if (mark == s.generation)
+        continue;
+      mark = s.generation;
+
+      const nfa_state & state = nfa_[static_cast<std::size_t>(id)];
+      switch (state.op) {
+        case nfa_state::bytes:
+        case nfa_state::eol:
+        case nfa_state::accept:
+          out.push_back(id);
+          break;
+        case nfa_state::split:
+          s.stack.push_back(state.out1);
+          s.stack.push_back(state.out);
+          break;
+        case nfa_state::jump:
+          s.stack.push_back(state.out);
+          break;
+        case nfa_state::bol:
+          if (at_start)
+            s.stack.push_back(state.out);
+          break;
+      }
+    }
+    std::sort(out.begin(), out.end());
+  }
+
+  inline void pattern::step(const std::vector<int> & from, unsigned char byte,
+      std::vector<int> & out, scratch & s) const
+  {
+    for (int id : from) {
+      const nfa_state & state = nfa_[static_cast<std::size_t>(id)];
+      if (state.op == nfa_state::bytes && 
+          sets_[static_cast<std::size_t>(state.set)][byte])
+        s.stack.push_back(state.out);
+    }
+    closure(false, out, s);
+  }
+
+  // Whether set accepts at the end of the input, where $ can be passed.
+  inline bool pattern::accepts(const std::vector<int> & set,
+      scratch & s) const
+  {
+    next_generation(s);
+    s.stack.assign(set.begin(), set.end());
+
+    bool found = false;
+    while (!s.stack.empty() && !found) {
+      int id = s.stack.back();
+      s.stack.pop_back();
+
+      unsigned & mark = s.marks[static_cast<std::size_t>(id)];
+      if (mark == s.generation)
+        continue;
+      mark = s.generation;
+
+      const nfa_state & state = nfa_[static_cast<std::size_t>(id)];
+      switch (state.op) {
+        case nfa_state::accept:
+          found = true;
+          break;
+        case nfa_state::split:
+          s.stack.push_back(state.out1);
+          s.stack.push_back(state.out);
+          break;
+        case nfa_state::jump:
+        case nfa_state::eol:
+          s.stack.push_back(state.out);
+          break;
+        case nfa_state::bytes:
+        case nfa_state::bol:
+          break;
+      }
+    }
+    s.stack.clear();
+    return found;
+  }
+
+  // Called from the constructor or with the cache mutex held.
+  inline int pattern::add_dfa_state(const std::vector<int> & set,
+      scratch & s) const
+  {
+    dfa_cache & cache = *cache_;
+    const std::size_t id = cache.sets.size();
+
+    if (id % dfa_cache::block_rows == 0) {
+      const std::size_t cells = dfa_cache::block_rows * nclasses_;
+      auto & block = cache.blocks[id / dfa_cache::block_rows];
+      block.reset(new std::atomic<int>[cells]);
+      for (std::size_t i = 0; i < cells; ++i)
+        block[i].store(i < nclasses_ && id == dead ? dead : -1,
+          std::memory_order_relaxed);
+    }
+
+    cache.accepting[id] = accepts(set, s);
+    cache.sets.push_back(set);
+    cache.index.emplace(set, static_cast<int>(id));
+    return static_cast<int>(id);
+  }
+
+  // Next DFA state, built on first use; -1 when the cache is full.
+  inline int pattern::transition(int state, unsigned char byte,
+      scratch & s) const
+  {
+    dfa_cache & cache = *cache_;
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    std::atomic<int> & cell = cache.cell(state, classes_[byte]);
+    int target = cell.load(std::memory_order_relaxed);
+    if (target >= 0)
+      return target;
+
+    step(cache.sets[static_cast<std::size_t>(state)], byte, s.next, s);
+
+    auto found = cache.index.find(s.next);
+    if (found != cache.index.end())
+      target = found->second;
+    else if (cache.sets.size() < max_states_)
+      target = add_dfa_state(s.next, s);
+    else
+      return -1;
+
+    cell.store(target, std::memory_order_release);
+    return target;
+  }
+
+  inline bool pattern::simulate(int state, std::string_view rest,
+      scratch & s) const
+  {
+    {
+      std::lock_guard<std::mutex> lock(cache_->mutex);
+      s.current = cache_->sets[static_cast<std::size_t>(state)];
+    }
+
+    for (char c : rest) {
+      step(s.current, static_cast<unsigned char>(c), s.next, s);
+      if (s.next.empty())
+        return false;
+      s.current.swap(s.next);
+    }
+
+    return accepts(s.current, s);
+  }
+
+  inline bool pattern::matches(std::string_view input) const
+  {
+    dfa_cache & cache = *cache_;
+    int state = start_;
+
+    for (std::size_t i = 0; i < input.size(); ++i) {
+      auto byte = static_cast<unsigned char>(input[i]);
+      int next = cache.cell(state, classes_[byte])
+        .load(std::memory_order_acquire);
+
+      if (next < 0) {
+        scratch & s = local_scratch();
+        next = transition(state, byte, s);
+        if (next < 0)
+          return simulate(state, input.substr(i), s);
+      }
+
+      if (next == dead)
+        return false;
+      state = next;
+    }
+
+    return cache.accepting[static_cast<std::size_t>(state)];
+  }
+
+  template<typename T>
+  struct MatchesRegex
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      static_assert(detail::is_string_like<U>::value, "expects a string");
+
+      return expected.matches(detail::as_string_view(actual));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "match regex " << expected.source();
+    }
+  };
+
+  // The sub-matchers are evaluated in place, left to right, stopping at the
+  // first one that matches; they may be of different types.
+  template<class T, class ... Ts>
+  struct AnyOf
+  {
+    static_assert(is_matcher<T>::value && (is_matcher<Ts>::value && ...),
+        "anyOf expects Matcher arguments");
+
+    template<class U>
+    bool matches(const U & actual, const T & first, const Ts & ... rest) const
+    {
+      return first.matches(actual) || (rest.matches(actual) || ...);
+    }
+
+    template<class U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & first, const Ts & ... rest) const
+    {
+      first.matches_all(values, n, words);
+
+      if constexpr (sizeof...(Ts) > 0) {
+        const std::size_t count = match_mask::word_count(n);
+        std::vector<std::uint64_t> scratch(count);
+        ((rest.matches_all(values, n, scratch.data()), 
+          simd::or_words(words, scratch.data(), count)), ...);
+      }
+    }
+
+    void describe(writer& o, const T & first, const Ts & ... rest) const
+    {
+      o << "any of " << first;
+      ((o << " or " << rest), ...);
+    }
+  };
+
+  template<class T, class ... Ts>
+  struct OneOf
+  {
+    template<class U>
+    bool matches(const U & actual, const T & first, const Ts & ... rest) const
+    {
+      return actual == first || ((actual == rest) || ...);
+    }
+
+    template<class U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & first, const Ts & ... rest) const
+    {
+      simd::mask_if(values, n, words, [&](const U & v) {
+        return IsEqual<T>().matches(v, first) |
+          (IsEqual<Ts>().matches(v, rest) | ...);
+      });
+    }
+
+    void describe(writer& o, const T & first, const Ts & ... rest) const
+    {
+      o << "one of (" << first;
+      ((o << ", " << rest), ...);
+      o << ')';
+    }
+  };
+
+  // anyOf() over equal() leaves of arithmetic values, as anyOf() builds
+  // it: every value is compared without branching, and the description is
+  // that of the matchers it replaces.
+  template<class T, class ... Ts>
+  struct AnyOfEqual
+  {
+    template<class U>
+    bool matches(const U & actual, const T & first, const Ts & ... rest) const
+    {
+      return IsEqual<T>().matches(actual, first) | 
+        (IsEqual<Ts>().matches(actual, rest) | ...);
+    }
+
+    template<class U>
+    void matches_all(const U * values, std::size_t n, std::uint64_t * words,
+        const T & first, const Ts & ... rest) const
+    {
+      simd::mask_if(values, n, words, [&](const U & v) {
+        return IsEqual<T>().matches(v, first) |
+          (IsEqual<Ts>().matches(v, rest) | ...);
+      });
+    }
+
+    void describe(writer& o, const T & first, const Ts & ... rest) const
+    {
+      o << "any of ";
+      IsEqual<T>().describe(o, first);
+      ((o << " or ", IsEqual<Ts>().describe(o, rest)), ...);
+    }
+  };
+
+  template<typename...>
+  struct IsNull;
+
+  template<>
+  struct IsNull<>
+  {
+    template<typename T>
+    bool matches(const T & actual) const
+    {
+      if constexpr (std::is_array<T>::value) {
+        return false;
+      } else {
+        static_assert(std::is_convertible<
+            decltype(actual == nullptr), bool>::value,
+          "expects a pointer-like value");
+        return actual == nullptr;
+      }
+    }
+
+    void describe(writer& o) const {
+      o << "null";
+    }
+  };
+
+  // Allocation accounting. Counters are per thread and only move when the
+  // replacement operator new and delete are compiled in, which happens in
+  // the one translation unit that defines MATCHA_ALLOCATION_HOOKS before
+  // including this header.
+  namespace allocation {
+
+    struct stats
+    {
+      std::size_t count = 0;
+      std::size_t bytes = 0;
+    };
+
+    // Allocations made by the calling thread since it started.
+    inline stats & thread_stats() noexcept {
+      static thread_local stats s;
+      return s;
+    }
+
+    // What the last expect() on the calling thread allocated, matching and
+    // reporting included.
+    inline stats & last_expect() noexcept {
+      static thread_local stats s;
+      return s;
+    }
+
+    inline bool & hooks_installed() noexcept {
+      static bool installed = false;
+      return installed;
+    }
+
+    inline void record(std::size_t bytes) noexcept {
+      stats & s = thread_stats();
+      ++s.count;
+      s.bytes += bytes;
+    }
+
+    // Measures what the calling thread allocates during its lifetime.
+    class scope
+    {
+    public:
+      scope() noexcept : start_(thread_stats()) { }
+
+      stats elapsed() const noexcept {
+        const stats & now = thread_stats();
+        return stats { now.count - start_.count, now.bytes - start_.bytes };
+      }
+
+    private:
+      stats start_;
+    };
+
+  }; // end allocation
+
+  // How the item quantifiers below walk a container. par splits
+  // random-access containers into chunks of grain items which run on the
+  // shared thread pool; any other container is walked sequentially.
+  struct execution_policy
+  {
+    bool parallel = false;
+    std::size_t grain = 1 << 14;
+  };
+
+  namespace execution {
+    inline constexpr execution_policy seq { false };
+    inline constexpr execution_policy par { true };
+  }; // end execution
+
+  namespace detail {
+
+    // Fork-join pool of hardware_concurrency() - 1 workers; the thread
+    // calling run() takes part as slot 0. Chunks are dealt out as one
+    // [begin, end) run per slot, the owner takes from the front and idle
+    // slots steal from the back of the others, so uneven chunks balance
+    // out without a shared queue.
+    class thread_pool
+    {
+    public:
+      explicit thread_pool(unsigned workers)
+        : slots_(new slot[workers + 1])
+        , nslots_(workers + 1)
+      {
+        for (unsigned i = 1; i <= workers; ++i)
+          threads_.emplace_back([this, i] { work_loop(i); });
+      }
+
+      ~thread_pool() {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto & t : threads_)
+          t.join();
+      }
+
+      thread_pool(const thread_pool &) = delete;
+      thread_pool & operator=(const thread_pool &) = delete;
+
+      static thread_pool & instance() {
+        static thread_pool pool(
+          std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+      }
+
+      unsigned slots() const { return nslots_; }
+
+      // Calls body(chunk, slot) for every chunk in [0, chunks) and returns
+      // when all of them are done, rethrowing the first exception thrown.
+      // slot < slots() is unique among the concurrent calls. Calls from
+      // within a body run inline on the calling thread.
+      template<class F>
+      void run(std::size_t chunks, F & body)
+      {
+        if (nslots_ == 1 || in_pool()) {
+          for (std::size_t c = 0; c < chunks; ++c)
+            body(c, 0);
+          return;
+        }
+
+        std::lock_guard<std::mutex> serial(run_mutex_);
+
+        body_ = &body;
+        invoke_ = [](void * f, std::size_t chunk, unsigned slot) {
+          (*static_cast<F *>(f))(chunk, slot);
+        };
+        error_ = nullptr;
+
+        for (unsigned s = 0; s < nslots_; ++s) {
+          const std::size_t b = chunks * s / nslots_;
+          const std::size_t e = chunks * (s + 1) / nslots_;
+          slots_[s].range.store(pack(b, e), std::memory_order_relaxed);
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          ++generation_;
+          pending_ = nslots_ - 1;
+        }
+        wake_.notify_all();
+
+        in_pool() = true;
+        work(0);
+        in_pool() = false;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+
+        if (error_)
+          std::rethrow_exception(error_);
+      }
+
+      // Chunk indices are packed two to a word, 32 bits each.
+      static constexpr std::size_t max_chunks = 0xffffffffu;
+
+    private:
+      struct alignas(64) slot
+      {
+        std::atomic<std::uint64_t> range { 0 };
+      };
+
+      static std::uint64_t pack(std::size_t begin, std::size_t end) {
+        return std::uint64_t(begin) << 32 | std::uint64_t(end);
+      }
+
+      // Set on the workers and on a thread while it takes part in run().
+      static bool & in_pool() {
+        static thread_local bool flag = false;
+        return flag;
+      }
+
+      bool take(unsigned s, bool front, std::size_t & chunk)
+      {
+        auto & range = slots_[s].range;
+        std::uint64_t cur = range.load(std::memory_order_relaxed);
+
+        for (;;) {
+          const std::size_t b = cur >> 32;
+          const std::size_t e = cur & 0xffffffffu;
+          if (b >= e)
+            return false;
+
+          const std::uint64_t next = front ? pack(b + 1, e) : pack(b, e - 1);
+          if (range.compare_exchange_weak(cur, next,
+                std::memory_order_relaxed)) {
+            chunk = front ? b : e - 1;
+            return true;
+          }
+        }
+      }
+
+      void work(unsigned self)
+      {
+        std::size_t chunk;
+
+        for (;;) {
+          bool found = take(self, true, chunk);
+          for (unsigned k = 1; !found && k < nslots_; ++k)
+            found = take((self + k) % nslots_, false, chunk);
+          if (!found)
+            return;
+
+          try {
+            invoke_(body_, chunk, self);
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+              error_ = std::current_exception();
+          }
+        }
+      }
+
+      void work_loop(unsigned self)
+      {
+        in_pool() = true;
+        std::size_t seen = 0;
+
+        for (;;) {
+          {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+              return;
+            seen = generation_;
+          }
+
+          work(self);
+
+          std::lock_guard<std::mutex> lock(mutex_);
+          if (--pending_ == 0)
+            done_.notify_one();
+        }
+      }
+
+      std::unique_ptr<slot[]> slots_;
+      unsigned nslots_;
+      std::vector<std::thread> threads_;
+
+      std::mutex run_mutex_;
+      std::mutex mutex_;
+      std::condition_variable wake_;
+      std::condition_variable done_;
+      std::size_t generation_ = 0;
+      unsigned pending_ = 0;
+      bool stop_ = false;
+
+      void * body_ = nullptr;
+      void (*invoke_)(void *, std::size_t, unsigned) = nullptr;
+      std::exception_ptr error_;
+    };
+
+    constexpr std::size_t no_item = std::size_t(-1);
+
+    // Index of the first item of actual for which item.matches() returns
+    // decisive, or no_item. The parallel walk shares item between the slots
+    // and lowers a shared bound whenever it finds a decisive item; chunks
+    // past the bound are skipped or abandoned, and those before it always
+    // run to completion, so the lowest index wins.
+    template<class C, class M>
+    std::size_t find_item(const C & actual, const M & item, bool decisive,
+        const execution_policy & policy)
+    {
+      using std::begin;
+      using std::end;
+
+      if constexpr (is_random_access<C>::value) {
+        auto first = begin(actual);
+        const std::size_t n = static_cast<std::size_t>(end(actual) - first);
+        const std::size_t grain = std::max<std::size_t>(
+          {policy.grain, 1, n / thread_pool::max_chunks + 1});
+        const std::size_t chunks = (n + grain - 1) / grain;
+
+        if (policy.parallel && chunks > 1 && 
+            thread_pool::instance().slots() > 1) {
+          std::atomic<std::size_t> bound(n);
+
+          auto body = [&](std::size_t chunk, unsigned) {
+            std::size_t i = chunk * grain;
+            const std::size_t last = std::min(n, i + grain);
+
+            for (; i < last; ++i) {
+              if (i % 1024 == 0 && i >= bound.load(std::memory_order_relaxed))
+                return;
+
+              if (item.matches(first[i]) == decisive) {
+                std::size_t cur = bound.load(std::memory_order_relaxed);
+                while (i < cur && !bound.compare_exchange_weak(cur, i,
+                         std::memory_order_relaxed))
+                  ;
+                return;
+              }
+            }
+          };
+
+          thread_pool::instance().run(chunks, body);
+
+          const std::size_t found = bound.load();
+          return found == n ? no_item : found;
+        }
+      }
+
+      std::size_t i = 0;
+      for (auto first = begin(actual); first != end(actual); ++first, ++i) {
+        if (item.matches(*first) == decisive)
+          return i;
+      }
+      return no_item;
+    }
+
+    // Index found by the last quantifier evaluated on this thread, for
+    // single-pass ranges which cannot be walked again to report it.
+    inline std::size_t & last_item() {
+      static thread_local std::size_t index = no_item;
+      return index;
+    }
+
+    template<class C, class M>
+    std::size_t find_item_and_keep(const C & actual, const M & item,
+        bool decisive, const execution_policy & policy)
+    {
+      return last_item() = find_item(actual, item, decisive, policy);
+    }
+
+    // The decisive item, found again in multi-pass containers.
+    template<class C, class M>
+    std::size_t item_index(const C & actual, const M & item, bool decisive,
+        const execution_policy & policy)
+    {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value)
+        return find_item(actual, item, decisive, policy);
+      else
+        return last_item();
+    }
+
+    // Reports the decisive item with the item matcher's own explanation.
+    // Matchers hold no evaluation state, so multi-pass containers are
+    // searched again.
+    template<class C, class M>
+    void describe_item(writer& o, const C & actual, const M & item,
+        bool decisive, const execution_policy & policy)
+    {
+      using std::begin;
+
+      if constexpr (is_multipass<decltype(begin(actual))>::value) {
+        const std::size_t index = find_item(actual, item, decisive, policy);
+        if (index == no_item)
+          return;
+
+        const auto & value = *std::next(begin(actual), index);
+        o << ", but item " << index << " was " << value;
+        item.describe_mismatch(o, value);
+      } else if (last_item() != no_item) {
+        o << ", but item " << last_item();
+      }
+    }
+
+  }; // end detail
+
+  template<class P, class T>
+  struct EveryItem
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    template<class C>
+    bool matches(const C & actual, const P & policy, const T & item) const
+    {
+      static_assert(is_container<C>::value, "expects a Container");
+      return detail::find_item_and_keep(actual, item, false, policy) ==
+        detail::no_item;
+    }
+
+    void describe(writer& o, const P &, const T & item) const {
+      o << "every item " << item;
+    }
+
+    template<class C>
+    void describe_mismatch(writer& o, const C & actual, const P & policy,
+        const T & item) const {
+      detail::describe_item(o, actual, item, false, policy);
+    }
+
+    template<class C>
+    std::size_t mismatch_index(const C & actual, const P & policy,
+        const T & item) const {
+      return detail::item_index(actual, item, false, policy);
+    }
+  };
+
+  template<class P, class T>
+  struct AnyItem
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    template<class C>
+    bool matches(const C & actual, const P & policy, const T & item) const
+    {
+      static_assert(is_container<C>::value, "expects a Container");
+      return detail::find_item(actual, item, true, policy) != detail::no_item;
+    }
+
+    void describe(writer& o, const P &, const T & item) const {
+      o << "any item " << item;
+    }
+  };
+
+  template<class P, class T>
+  struct NoItem
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    template<class C>
+    bool matches(const C & actual, const P & policy, const T & item) const
+    {
+      static_assert(is_container<C>::value, "expects a Container");
+      return detail::find_item_and_keep(actual, item, true, policy) ==
+        detail::no_item;
+    }
+
+    void describe(writer& o, const P &, const T & item) const {
+      o << "no item " << item;
+    }
+
+    template<class C>
+    void describe_mismatch(writer& o, const C & actual, const P & policy,
+        const T & item) const {
+      detail::describe_item(o, actual, item, true, policy);
+    }
+
+    template<class C>
+    std::size_t mismatch_index(const C & actual, const P & policy,
+        const T & item) const {
+      return detail::item_index(actual, item, true, policy);
+    }
+  };
+
+  template<class T>
+  struct AllocatesAtMost
+  {
+    template<class F>
+    bool matches(const F & callable, const T & limit) const
+    {
+      static_assert(std::is_invocable<const F &>::value, 
+        "expects a callable taking no arguments");
+
+      allocation::scope scope;
+      callable();
+      const allocation::stats & used = last_used() = scope.elapsed();
+
+      return allocation::hooks_installed() && used.count <= limit;
+    }
+
+    void describe(writer& o, const T & limit) const {
+      o << "allocate at most " << limit << (limit == 1 ? " time" : " times");
+    }
+
+    template<class F>
+    void describe_mismatch(writer& o, const F &, const T &) const {
+      if (!allocation::hooks_installed())
+        o << ", but allocations are not counted without "
+             "MATCHA_ALLOCATION_HOOKS";
+      else
+        o << ", but allocated " << last_used().count 
+          << (last_used().count == 1 ? " time (" : " times (") 
+          << last_used().bytes << " bytes)";
+    }
+
+  private:
+    // The callable cannot be run again to describe the mismatch, so the
+    // last measurement is kept per thread rather than in the matcher.
+    static allocation::stats & last_used() {
+      static thread_local allocation::stats used;
+      return used;
+    }
+  };
+
+  template <typename T>
+  std::string to_string(const T & val)
+  {
+    writer out;
+    out << val;
+    return out.str();
+  }
+
+  // Destination of failure messages. report() receives one complete
+  // message at a time, including its trailing newline, and may be called
+  // from any thread.
+  class reporter
+  {
+  public:
+    virtual ~reporter() = default;
+
+    virtual void report(std::string_view message) = 0;
+
+    // Returns once everything reported so far has been written.
+    virtual void flush() { }
+  };
+
+  // Writes each message straight to a stream under a lock.
+  class ostream_reporter : public reporter
+  {
+  public:
+    explicit ostream_reporter(std::ostream & stream) : stream_(stream) { }
+
+    void report(std::string_view message) override {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stream_.write(message.data(), 
+        static_cast<std::streamsize>(message.size()));
+    }
+
+    void flush() override {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stream_.flush();
+    }
+
+  private:
+    std::ostream & stream_;
+    std::mutex mutex_;
+  };
+
+  // Hands messages to a background thread which writes them to a stream in
+  // batches, so that failing threads do not wait on the stream. Each
+  // reporting thread gets a ring buffer of its own, filled by that thread
+  // alone and drained by the writer thread alone, so a report is two
+  // memcpys and a release store. Messages from one thread keep their
+  // order; a thread whose ring is full waits for the writer, and messages
+  // larger than a ring are written directly once the ring has drained.
+  class async_reporter : public reporter
+  {
+  public:
+    explicit async_reporter(std::ostream & stream,
+        std::size_t ring_capacity = 1 << 16)
+      : stream_(stream)
+      , capacity_(round_up(ring_capacity))
+      , id_(next_id())
+      , thread_([this] { run(); })
+    { }
+
+    ~async_reporter() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_one();
+      thread_.join();
+    }
+
+    void report(std::string_view message) override
+    {
+      ring & r = local_ring();
+
+      if (message.size() > capacity_) {
+        while (!r.empty())
+          wait_for_writer();
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        stream_.write(message.data(), 
+          static_cast<std::streamsize>(message.size()));
+        return;
+      }
+
+      const bool was_empty = r.empty();
+      while (!r.try_push(message))
+        wait_for_writer();
+
+      if (was_empty)
+        wake_writer();
+    }
+
+    void flush() override
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      const std::uint64_t request = ++flush_requested_;
+      wake_.notify_one();
+      flushed_cv_.wait(lock, [&] { return flushed_ >= request; });
+    }
+
+  private:
+    // Single-producer single-consumer byte ring. Positions only grow and
+    // are reduced modulo the capacity, a power of two. The producer pushes
+    // whole messages, so the tail is always at a message boundary.
+    class ring
+    {
+    public:
+      explicit ring(std::size_t capacity)
+        : buffer_(new char[capacity])
+        , capacity_(capacity)
+      { }
+
+      bool empty() const {
+        return head_.load(std::memory_order_acquire) ==
+          tail_.load(std::memory_order_acquire);
+      }
+
+      bool try_push(std::string_view message)
+      {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        const std::size_t head = head_.load(std::memory_order_acquire);
+        if (capacity_ - (tail - head) < message.size())
+          return false;
+
+        copy_in(tail, message.data(), message.size());
+        tail_.store(tail + message.size(), std::memory_order_release);
+        return true;
+      }
+
+      // Appends everything pushed so far to out.
+      void drain(std::string & out)
+      {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        const std::size_t tail = tail_.load(std::memory_order_acquire);
+        if (head == tail)
+          return;
+
+        const std::size_t at = head & (capacity_ - 1);
+        const std::size_t first = std::min(tail - head, capacity_ - at);
+        out.append(buffer_.get() + at, first);
+        out.append(buffer_.get(), tail - head - first);
+        head_.store(tail, std::memory_order_release);
+      }
+
+    private:
+      void copy_in(std::size_t pos, const char * data, std::size_t n) {
+        const std::size_t at = pos & (capacity_ - 1);
+        const std::size_t first = std::min(n, capacity_ - at);
+        std::memcpy(buffer_.get() + at, data, first);
+        std::memcpy(buffer_.get(), data + first, n - first);
+      }
+
+      std::unique_ptr<char[]> buffer_;
+      std::size_t capacity_;
+      alignas(64) std::atomic<std::size_t> head_ { 0 };
+      alignas(64) std::atomic<std::size_t> tail_ { 0 };
+    };
+
+    static std::size_t round_up(std::size_t n) {
+      std::size_t capacity = 64;
+      while (capacity < n)
+        capacity *= 2;
+      return capacity;
+    }
+
+    static std::uint64_t next_id() {
+      static std::atomic<std::uint64_t> id { 0 };
+      return ++id;
+    }
+
+    // Reporters are told apart by id rather than address, which a later
+    // reporter may reuse.
+    ring & local_ring()
+    {
+      struct cached
+      {
+        std::uint64_t id = 0;
+        ring * r = nullptr;
+      };
+      static thread_local cached last;
+
+      if (last.id != id_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto & r = rings_[std::this_thread::get_id()];
+        if (!r)
+          r.reset(new ring(capacity_));
+        last.id = id_;
+        last.r = r.get();
+      }
+      return *last.r;
+    }
+
+    // A wake-up racing with the writer going to sleep is only delayed
+    // until its next periodic pass.
+    void wake_writer() {
+      ready_.store(true, std::memory_order_release);
+      wake_.notify_one();
+    }
+
+    void wait_for_writer() {
+      wake_writer();
+      std::this_thread::yield();
+    }
+
+    void run()
+    {
+      std::string batch;
+      std::vector<ring *> rings;
+
+      for (;;) {
+        bool stop;
+        std::uint64_t flush_request;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          wake_.wait_for(lock, std::chrono::milliseconds(10), [this] {
+            return stop_ || flush_requested_ != flushed_ || 
+              ready_.exchange(false, std::memory_order_acquire);
+          });
+          stop = stop_;
+          flush_request = flush_requested_ != flushed_ ? flush_requested_ : 0;
+          rings.clear();
+          for (auto & r : rings_)
+            rings.push_back(r.second.get());
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(write_mutex_);
+          batch.clear();
+          for (ring * r : rings)
+            r->drain(batch);
+          if (!batch.empty())
+            stream_.write(batch.data(), 
+              static_cast<std::streamsize>(batch.size()));
+          if (flush_request != 0 || stop)
+            stream_.flush();
+        }
+
+        if (flush_request != 0) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          flushed_ = flush_request;
+          flushed_cv_.notify_all();
+        }
+
+        if (stop)
+          return;
+      }
+    }
+
+    std::ostream & stream_;
+    const std::size_t capacity_;
+    const std::uint64_t id_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_cv_;
+    std::map<std::thread::id, std::unique_ptr<ring>> rings_;
+    std::uint64_t flush_requested_ = 0;
+    std::uint64_t flushed_ = 0;
+    bool stop_ = false;
+    std::atomic<bool> ready_ { false };
+
+    std::mutex write_mutex_;
+
+    std::thread thread_;
+  };
+
+  namespace detail {
+
+    inline std::atomic<reporter *> & installed_reporter() {
+      static std::atomic<reporter *> r { nullptr };
+      return r;
+    }
+
+  }; // end detail
+
+  // The reporter expect() sends failures to; std::cout unless replaced.
+  inline reporter & current_reporter() {
+    static ostream_reporter console(std::cout);
+    reporter * r = detail::installed_reporter().load(std::memory_order_acquire);
+    return r ? *r : console;
+  }
+
+  // Installs r, or the std::cout default for nullptr, and returns the
+  // reporter it replaces. r must outlive its use by expect().
+  inline reporter * set_reporter(reporter * r) {
+    return detail::installed_reporter().exchange(r, std::memory_order_acq_rel);
+  }
+
+  template<typename T>
+  struct output_traits;
+
+  template<>
+  struct output_traits<bool>
+  {
+    typedef bool result_type;
+    static constexpr bool success = true;
+    static constexpr bool failure = false;
+
+    static void report(bool &, std::string_view message) {
+      current_reporter().report(message);
+    }
+  };
+
+
+  // How much of the actual and expected values a failure message prints;
+  // see print_limits. Containers are windowed around the element the
+  // matcher reports the failure at. Adjust before expectations run.
+  inline print_limits & failure_limits() {
+    static print_limits limits{32, 8, 1 << 16, print_limits::none};
+    return limits;
+  }
+
+  template<class Result, class T, class U>
+  auto assertResult(T const& actual, U && matcher, 
+      stats::site where = stats::site::current()) 
+  {
+    Result result = output_traits<Result>::failure;
+    //const std::string red("\033[0;31m");
+    //const std::string green("\033[1;32m");
+
+    stats::site_scope site(where);
+    allocation::scope allocations;
+
+    if (matcher.matches(actual)) {
+      allocation::last_expect() = allocations.elapsed();
+      return output_traits<Result>::success;
+    }
+
+    {
+      print_limits limits = failure_limits();
+      limits.focus = matcher.mismatch_index(actual);
+
+      writer out;
+      out.limit(limits);
+      out << "expected " << actual << ' ' << matcher;
+      matcher.describe_mismatch(out, actual);
+      out << '\n';
+      output_traits<Result>::report(result, out.view());
+    }
+
+    allocation::last_expect() = allocations.elapsed();
+    return result;
+  }
+
+  template<class T, class Matcher>
+  auto expect(T const& actual, Matcher && matcher,
+      stats::site where = stats::site::current()) {
+    return assertResult<bool>(actual, matcher, where);
+  }
+
+  template<class Iter, class Sentinel, class Matcher>
+  auto expect(Iter first, Sentinel last, Matcher && matcher,
+      stats::site where = stats::site::current()) {
+    return assertResult<bool>(range<Iter,Sentinel>(first, last), matcher, 
+      where);
+  }
+
+#if defined(__cpp_lib_ranges)
+  // Views and other ranges that are not containers, e.g. lazy
+  // views::transform pipelines, are consumed in place.
+  template<std::ranges::input_range R, class Matcher>
+    requires (!is_container<std::remove_cvref_t<R>>::value
+           && !std::is_array_v<std::remove_cvref_t<R>>)
+  auto expect(R && r, Matcher && matcher,
+      stats::site where = stats::site::current()) {
+    return expect(std::ranges::begin(r), std::ranges::end(r), matcher, where);
+  }
+#endif
+
+  namespace detail {
+
+    // The factories below canonicalize what they are given: words are
+    // gathered into one Phrased layer, not(not(x)) becomes words over x,
+    // and anyOf() over arithmetic equal() leaves becomes one AnyOfEqual.
+    template<class M>
+    struct is_phrased : std::false_type { };
+
+    template<class W, class T>
+    struct is_phrased<Matcher<Phrased, W, T>> : std::true_type {
+      typedef W words_type;
+      typedef std::decay_t<T> inner_type;
+    };
+
+    template<class M>
+    struct is_negation : std::false_type { };
+
+    template<class T>
+    struct is_negation<Matcher<Not, T>> : std::true_type { };
+
+    template<class M>
+    struct is_equal_leaf : std::false_type { };
+
+    template<class T>
+    struct is_equal_leaf<Matcher<IsEqual, T>> 
+      : std::integral_constant<bool, 
+        std::is_arithmetic<predicate_arg_t<T>>::value> { };
+
+    // matcher with the words W in front, merged with those it has.
+    template<class W, class M>
+    auto with_words(M && matcher)
+    {
+      typedef std::decay_t<M> D;
+
+      if constexpr (is_phrased<D>::value)
+        return make_matcher<Phrased>(
+          typename join_words<W, typename is_phrased<D>::words_type>::type(),
+          std::get<1>(std::forward<M>(matcher).arguments()));
+      else
+        return make_matcher<Phrased>(W(), std::forward<M>(matcher));
+    }
+
+    template<class M>
+    auto negated(M && matcher)
+    {
+      typedef std::decay_t<M> D;
+
+      if constexpr (is_negation<D>::value) {
+        return with_words<words<word::not_, word::not_>>(
+          std::get<0>(std::forward<M>(matcher).arguments()));
+      } else if constexpr (is_phrased<D>::value) {
+        if constexpr (is_negation<typename is_phrased<D>::inner_type>::value)
+          return with_words<typename join_words<words<word::not_>,
+              typename join_words<typename is_phrased<D>::words_type,
+                words<word::not_>>::type>::type>(
+            std::get<0>(std::get<1>(
+              std::forward<M>(matcher).arguments()).arguments()));
+        else
+          return make_matcher<Not>(std::forward<M>(matcher));
+      } else {
+        return make_matcher<Not>(std::forward<M>(matcher));
+      }
+    }
+
+  }; // end detail
+
+  namespace predicates {
+
+    template <typename T>
+    auto to(T && matcher) {
+      return detail::with_words<detail::words<detail::word::to>>(
+        std::forward<T>(matcher));
+    }
+
+    template <typename T>
+    auto be(T && matcher) {
+      return detail::with_words<detail::words<detail::word::be>>(
+        std::forward<T>(matcher));
+    }
+
+    template <typename T>
+    auto have(T && matcher) {
+      return detail::with_words<detail::words<detail::word::have>>(
+        std::forward<T>(matcher));
+    }
+
+    template <typename T,
+      typename = std::enable_if_t<is_matcher<std::decay_t<T>>::value>>
+    auto operator!(T && matcher) {
+      return detail::negated(std::forward<T>(matcher));
+    }
+
+    inline auto null() {
+      return make_matcher<IsNull>();
+    }
+
+    template <class T, class ... Ts>
+    auto oneOf(T && first, Ts && ... rest) {
+      return make_matcher<OneOf>(std::forward<T>(first),
+        std::forward<Ts>(rest)...);
+    }
+
+    template <class T, class ... Ts> 
+    auto anyOf(T && first, Ts && ... rest) {
+      if constexpr (detail::is_equal_leaf<std::decay_t<T>>::value &&
+          (detail::is_equal_leaf<std::decay_t<Ts>>::value && ...))
+        return make_matcher<AnyOfEqual>(
+          std::get<0>(std::forward<T>(first).arguments()),
+          std::get<0>(std::forward<Ts>(rest).arguments())...);
+      else
+        return make_matcher<AnyOf>(std::forward<T>(first), 
+          std::forward<Ts>(rest)...);
+    }
+
+    inline auto startWith = [](auto && value) {
+      return make_matcher<StartsWith>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto startsWith = startWith;
+
+    inline auto endWith = [](auto && value) {
+      return make_matcher<EndsWith>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto endsWith = endWith;
+
+    inline auto containSubstring = [](auto && value) {
+      return make_matcher<ContainsSubstring>(
+        std::forward<decltype(value)>(value));
+    };
+
+    inline auto containsSubstring = containSubstring;
+
+    inline auto matchRegex = [](std::string_view source) {
+      return make_matcher<MatchesRegex>(pattern(source));
+    };
+
+    inline auto matchesRegex = matchRegex;
+
+    template <class T>
+    auto contain(T && value) {
+      return make_matcher<IsContaining>(std::forward<T>(value));
+    }
+
+    template <class Key, class T>
+    auto contain(Key && key, T && value) {
+      return make_matcher<IsContaining>(
+        detail::lookup_key(std::forward<Key>(key)), std::forward<T>(value));
+    }
+
+    // The elements are kept in a vector of their common type, string
+    // literals as std::string.
+    template <class T, class ... Ts>
+    auto containInAnyOrder(T && first, Ts && ... rest) {
+      typedef std::common_type_t<
+        std::decay_t<decltype(detail::lookup_key(std::declval<T>()))>,
+        std::decay_t<decltype(detail::lookup_key(std::declval<Ts>()))>...>
+        value_type;
+
+      return make_matcher<IsContainingInAnyOrder>(std::vector<value_type>{
+        value_type(detail::lookup_key(std::forward<T>(first))),
+        value_type(detail::lookup_key(std::forward<Ts>(rest)))...});
+    }
+
+    template <class T, class ... Ts>
+    auto containsInAnyOrder(T && first, Ts && ... rest) {
+      return containInAnyOrder(std::forward<T>(first), 
+        std::forward<Ts>(rest)...);
+    }
+
+    inline auto containAll = [](auto && values) {
+      return make_matcher<IsContainingAll>(
+        std::forward<decltype(values)>(values));
+    };
+
+    inline auto containsAll = containAll;
+
+    template <class T>
+    auto everyItem(execution_policy policy, T && matcher) {
+      return make_matcher<EveryItem>(std::move(policy),
+        std::forward<T>(matcher));
+    }
+
+    template <class T>
+    auto everyItem(T && matcher) {
+      return everyItem(execution::seq, std::forward<T>(matcher));
+    }
+
+    template <class T>
+    auto anyItem(execution_policy policy, T && matcher) {
+      return make_matcher<AnyItem>(std::move(policy),
+        std::forward<T>(matcher));
+    }
+
+    template <class T>
+    auto anyItem(T && matcher) {
+      return anyItem(execution::seq, std::forward<T>(matcher));
+    }
+
+    template <class T>
+    auto noItem(execution_policy policy, T && matcher) {
+      return make_matcher<NoItem>(std::move(policy),
+        std::forward<T>(matcher));
+    }
+
+    template <class T>
+    auto noItem(T && matcher) {
+      return noItem(execution::seq, std::forward<T>(matcher));
+    }
+
+    inline auto allocateAtMost = [](std::size_t limit) {
+      return make_matcher<AllocatesAtMost>(std::move(limit));
+    };
+
+    inline auto allocatesAtMost = allocateAtMost;
+
+    inline auto equal = [](auto && value) {
+      return make_matcher<IsEqual>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto equals = equal;
+
+    inline auto equalIgnoringOrder = [](auto && value) {
+      return make_matcher<IsEqualIgnoringOrder>(
+        std::forward<decltype(value)>(value));
+    };
+
+    inline auto equalsIgnoringOrder = equalIgnoringOrder;
+
+    template <class T, class Tolerance>
+    auto closeTo(T value, Tolerance tolerance) {
+      static_assert(std::is_arithmetic<T>::value && 
+        std::is_arithmetic<Tolerance>::value, "expects arithmetic values");
+      return make_matcher<IsCloseTo>(std::move(value), std::move(tolerance));
+    }
+
+    template <class T>
+    auto withinUlps(T value, std::uint64_t ulps) {
+      return make_matcher<IsWithinUlps>(std::move(value), std::move(ulps));
+    }
+
+    // Tolerances default to numpy.allclose's.
+    inline auto allClose = [](auto && expected, double rtol = 1e-5, 
+        double atol = 1e-8) {
+      return make_matcher<IsAllClose>(
+        std::forward<decltype(expected)>(expected), std::move(rtol),
+        std::move(atol));
+    };
+
+    inline auto lessThan = [](auto && value) {
+      return make_matcher<IsLessThan>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto greaterThan = [](auto && value) {
+      return make_matcher<IsGreaterThan>(std::forward<decltype(value)>(value));
+    };
+  }; // end predicates
+
+}; // end matcha
+
+namespace pretty_print {
+
+  template<template <class...> class Predicate, class ... Ts>
+  struct formatter<matcha::Matcher<Predicate,Ts...>>
+  {
+    static void format(writer & w, 
+        const matcha::Matcher<Predicate,Ts...> & matcher)
+    {
+      matcher.describe(w);
+    }
+  };
+
+  template<typename T>
+  struct formatter<matcha::AnyMatcher<T>>
+  {
+    static void format(writer & w, const matcha::AnyMatcher<T> & matcher)
+    {
+      matcher.describe(w);
+    }
+  };
+
+  // Single-pass ranges have been consumed by the time a failure is
+  // reported, so only multi-pass ranges print their elements.
+  template<class Iter, class Sentinel>
+  struct formatter<matcha::range<Iter,Sentinel>>
+  {
+    static void format(writer & w, const matcha::range<Iter,Sentinel> & r)
+    {
+      if constexpr (matcha::is_multipass<Iter>::value) {
+        print_container_helper<matcha::range<Iter,Sentinel>> helper(r);
+        helper(w);
+      } else {
+        w << "[single-pass range]";
+      }
+    }
+  };
+
+}; // end pretty_print
+
+#endif  // H_MATCHA
+
+// Replacement allocation functions feeding matcha::allocation. The library
+// forwards the array and nothrow forms to these.
+#if defined(MATCHA_ALLOCATION_HOOKS) && !defined(H_MATCHA_ALLOCATION_HOOKS)
+#define H_MATCHA_ALLOCATION_HOOKS
+
+#include <cstdlib>
+#include <new>
+
+namespace matcha {
+  namespace allocation {
+    static const bool hooks_registered = (hooks_installed() = true);
+  };
+};
+
+// Out of line, so that GCC does not see free() inlined against new.
+#if defined(__GNUC__)
+#define MATCHA_HOOK __attribute__((noinline))
+#else
+#define MATCHA_HOOK
+#endif
+
+MATCHA_HOOK void * operator new(std::size_t size)
+{
+  matcha::allocation::record(size);
+  if (void * p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+MATCHA_HOOK void * operator new(std::size_t size, std::align_val_t align)
+{
+  matcha::allocation::record(size);
+  const std::size_t a = static_cast<std::size_t>(align);
+  const std::size_t rounded = size ? (size + a - 1) / a * a : a;
+  if (void * p = std::aligned_alloc(a, rounded))
+    return p;
+  throw std::bad_alloc();
+}
+
+MATCHA_HOOK void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+MATCHA_HOOK void operator delete(void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+MATCHA_HOOK void operator delete(void * p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+MATCHA_HOOK void operator delete(void * p, std::size_t, 
+    std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+#undef MATCHA_HOOK
+
+#endif
@@ -0,0 +1,402 @@
+// Micro-benchmarks for matcher evaluation and failure rendering.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -pthread matcha_bench.cc -o matcha_bench
+//   ./matcha_bench [--filter=substring] [--min-time=seconds]
+//
+// Prints one JSON object per line: a context record, then one record per
+// benchmark with ns/op, heap bytes/op and allocations/op, so runs can be
+// diffed between releases.
+
+#define MATCHA_ALLOCATION_HOOKS
+#include "matcha.hpp"
+#include "matcha_rules.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <numeric>
+#include <set>
+#include <unordered_set>
+
+namespace {
+
+  using namespace matcha::predicates;
+  using matcha::writer;
+
+  template<class T>
+  inline void do_not_optimize(const T & value)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void * sink;
+    sink = &value;
+#endif
+  }
+
+  struct options
+  {
+    std::string filter;
+    double min_time = 0.1;
+  };
+
+  options opts;
+
+  // Doubles the iteration count until a batch takes min_time, then reports
+  // that batch. op() performs one operation.
+  template<class F>
+  void run(const char * name, const char * path, std::size_t size, F op)
+  {
+    writer id;
+    id << name << '/' << path << '/' << size;
+    if (id.str().find(opts.filter) == std::string::npos)
+      return;
+
+    typedef std::chrono::steady_clock clock;
+
+    op();  // warm caches, lazily built state and the pool
+
+    std::size_t iterations = 1;
+    for (;;) {
+      const matcha::allocation::scope allocations;
+      const auto start = clock::now();
+
+      for (std::size_t i = 0; i < iterations; ++i)
+        do_not_optimize(op());
+
+      const std::chrono::duration<double> elapsed = clock::now() - start;
+      const matcha::allocation::stats used = allocations.elapsed();
+
+      if (elapsed.count() >= opts.min_time || iterations >= (1u << 30)) {
+        const double n = static_cast<double>(iterations);
+        writer out(std::cout);
+        out << "{\"name\":\"" << name << "\",\"path\":\"" << path
+            << "\",\"size\":" << size
+            << ",\"iterations\":" << iterations
+            << ",\"ns_per_op\":" << elapsed.count() * 1e9 / n
+            << ",\"bytes_per_op\":" << used.bytes / n
+            << ",\"allocs_per_op\":" << used.count / n
+            << "}\n";
+        return;
+      }
+
+      iterations *= 2;
+    }
+  }
+
+  // Renders a failure the way expect() does, into a buffer instead of a
+  // stream, and returns its length.
+  template<class T, class M>
+  std::size_t render(const T & actual, M & matcher)
+  {
+    matcha::print_limits limits = matcha::failure_limits();
+    limits.focus = matcher.mismatch_index(actual);
+
+    writer out;
+    out.limit(limits);
+    out << "expected " << actual << ' ' << matcher;
+    matcher.describe_mismatch(out, actual);
+    out << '\n';
+    return out.size();
+  }
+
+  const std::size_t sizes[] = { 16, 1024, 65536 };
+
+  void bench_equal()
+  {
+    {
+      int actual = 42;
+      auto pass = equal(42);
+      auto fail = equal(43);
+      run("IsEqual<int>", "pass", 1, [&] { return pass.matches(actual); });
+      run("IsEqual<int>", "fail", 1, [&] { return fail.matches(actual); });
+      run("IsEqual<int>", "render", 1, [&] { return render(actual, fail); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::vector<int> actual(n);
+      std::iota(actual.begin(), actual.end(), 0);
+      std::vector<int> same(actual);
+      std::vector<int> last(actual);
+      last.back() = -1;
+
+      auto pass = equal(same);
+      auto fail = equal(last);
+      run("IsEqual<vector<int>>", "pass", n,
+        [&] { return pass.matches(actual); });
+      run("IsEqual<vector<int>>", "fail", n,
+        [&] { return fail.matches(actual); });
+      run("IsEqual<vector<int>>", "render", n,
+        [&] { return render(actual, fail); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::list<int> actual(n, 7);
+      std::list<int> last(actual);
+      last.back() = 8;
+
+      auto pass = equal(actual);
+      auto fail = equal(last);
+      run("IsEqual<list<int>>", "pass", n,
+        [&] { return pass.matches(actual); });
+      run("IsEqual<list<int>>", "fail", n,
+        [&] { return fail.matches(actual); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::vector<int> values(n);
+      std::iota(values.begin(), values.end(), 0);
+      std::unordered_set<int> actual(values.begin(), values.end());
+      std::set<int> ordered(values.begin(), values.end());
+      std::vector<int> reversed(values.rbegin(), values.rend());
+
+      auto same = equal(actual);
+      auto other = equal(ordered);
+      auto shuffled = equalIgnoringOrder(reversed);
+      run("IsEqual<unordered_set<int>>", "pass", n,
+        [&] { return same.matches(actual); });
+      run("IsEqual<unordered_set<int>>", "set", n,
+        [&] { return other.matches(actual); });
+      run("IsEqualIgnoringOrder<vector<int>>", "pass", n,
+        [&] { return shuffled.matches(values); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::string actual(n, 'a');
+      std::string last(actual);
+      last.back() = 'b';
+
+      auto pass = equal(actual);
+      auto fail = equal(last);
+      run("IsEqual<string>", "pass", n, [&] { return pass.matches(actual); });
+      run("IsEqual<string>", "fail", n, [&] { return fail.matches(actual); });
+      run("IsEqual<string>", "render", n,
+        [&] { return render(actual, fail); });
+    }
+  }
+
+  void bench_approx()
+  {
+    {
+      double actual = 0.1 + 0.2;
+      auto pass = closeTo(0.3, 1e-12);
+      auto ulps = withinUlps(0.3, 4);
+      run("IsCloseTo<double>", "pass", 1, [&] { return pass.matches(actual); });
+      run("IsWithinUlps<double>", "pass", 1,
+        [&] { return ulps.matches(actual); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::vector<double> actual(n);
+      for (std::size_t i = 0; i < n; ++i)
+        actual[i] = static_cast<double>(i) / 3;
+      std::vector<double> near(actual);
+      for (double & x : near)
+        x *= 1 + 1e-9;
+      std::vector<double> last(near);
+      last.back() += 1;
+
+      auto pass = allClose(near);
+      auto fail = allClose(last);
+      run("IsAllClose<vector<double>>", "pass", n,
+        [&] { return pass.matches(actual); });
+      run("IsAllClose<vector<double>>", "fail", n,
+        [&] { return fail.matches(actual); });
+      run("IsAllClose<vector<double>>", "render", n,
+        [&] { return render(actual, fail); });
+    }
+  }
+
+  void bench_contain()
+  {
+    for (std::size_t n : sizes) {
+      std::vector<int> actual(n);
+      std::iota(actual.begin(), actual.end(), 0);
+
+      auto pass = contain(static_cast<int>(n - 1));
+      auto fail = contain(-1);
+      run("IsContaining<vector<int>>", "pass", n,
+        [&] { return pass.matches(actual); });
+      run("IsContaining<vector<int>>", "fail", n,
+        [&] { return fail.matches(actual); });
+      run("IsContaining<vector<int>>", "render", n,
+        [&] { return render(actual, fail); });
+    }
+
+    // One hash table of the needles instead of a scan per needle.
+    for (std::size_t n : sizes) {
+      std::vector<int> actual(n);
+      std::iota(actual.begin(), actual.end(), 0);
+      std::vector<int> needles(actual.rbegin(), actual.rbegin() + n / 4);
+
+      auto all = containsAll(needles);
+      run("IsContainingAll<vector<int>>", "pass", n,
+        [&] { return all.matches(actual); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::vector<std::string> actual(n, "item");
+      actual.back() = "last";
+
+      auto pass = contain(std::string("last"));
+      auto fail = contain(std::string("none"));
+      run("IsContaining<vector<string>>", "pass", n,
+        [&] { return pass.matches(actual); });
+      run("IsContaining<vector<string>>", "fail", n,
+        [&] { return fail.matches(actual); });
+    }
+
+    for (std::size_t n : sizes) {
+      std::map<std::string, int> actual;
+      for (std::size_t i = 0; i < n; ++i)
+        actual.emplace("key" + std::to_string(i), static_cast<int>(i));
+
+      auto pass = contain("key0", 0);
+      auto fail = contain("key0", 1);
+      run("IsContaining<map<string,int>>", "pass", n,
+        [&] { return pass.matches(actual); });
+      run("IsContaining<map<string,int>>", "fail", n,
+        [&] { return fail.matches(actual); });
+    }
+  }
+
+  void bench_strings()
+  {
+    for (std::size_t n : sizes) {
+      std::string actual(n, 'x');
+      actual.replace(n - 4, 4, ".txt");
+
+      auto pass = endsWith(".txt");
+      auto fail = endsWith(".csv");
+      run("EndsWith", "pass", n, [&] { return pass.matches(actual); });
+      run("EndsWith", "fail", n, [&] { return fail.matches(actual); });
+      run("EndsWith", "render", n, [&] { return render(actual, fail); });
+
+      auto found = containsSubstring(".txt");
+      auto missing = containsSubstring(".csv");
+      run("ContainsSubstring", "pass", n,
+        [&] { return found.matches(actual); });
+      run("ContainsSubstring", "fail", n,
+        [&] { return missing.matches(actual); });
+    }
+  }
+
+  void bench_combinators()
+  {
+    int actual = 5;
+
+    {
+      auto pass = anyOf(equal(1), equal(3), equal(5));
+      auto fail = anyOf(equal(1), equal(3), equal(7));
+      run("AnyOf", "pass", 3, [&] { return pass.matches(actual); });
+      run("AnyOf", "fail", 3, [&] { return fail.matches(actual); });
+      run("AnyOf", "render", 3, [&] { return render(actual, fail); });
+    }
+
+    {
+      auto pass = oneOf(1, 2, 3, 4, 5, 6, 7, 8);
+      auto fail = oneOf(11, 12, 13, 14, 15, 16, 17, 18);
+      run("OneOf", "pass", 8, [&] { return pass.matches(actual); });
+      run("OneOf", "fail", 8, [&] { return fail.matches(actual); });
+      run("OneOf", "render", 8, [&] { return render(actual, fail); });
+    }
+
+    // The wrappers should cost nothing over the matcher they wrap.
+    {
+      auto bare = equal(5);
+      auto wrapped = to(be(equal(5)));
+      auto negated = to(not(equal(5)));
+      run("Equal", "pass", 1, [&] { return bare.matches(actual); });
+      run("To<Be<Equal>>", "pass", 1, [&] { return wrapped.matches(actual); });
+      run("To<Not<Equal>>", "fail", 1,
+        [&] { return negated.matches(actual); });
+      run("To<Not<Equal>>", "render", 1,
+        [&] { return render(actual, negated); });
+    }
+
+    // One indirect call over the matcher it holds.
+    {
+      matcha::AnyMatcher<int> erased = to(be(equal(5)));
+      run("AnyMatcher<To<Be<Equal>>>", "pass", 1,
+        [&] { return erased.matches(actual); });
+    }
+
+    // The same matchers compiled from text.
+    {
+      const matcha::rule pass("anyOf(equal(1), equal(3), equal(5))");
+      const matcha::rule fail("anyOf(equal(1), equal(3), equal(7))");
+      run("rule<anyOf>", "pass", 3, [&] { return pass.matches(actual); });
+      run("rule<anyOf>", "fail", 3, [&] { return fail.matches(actual); });
+    }
+  }
+
+  void bench_quantifiers()
+  {
+    for (std::size_t n : sizes) {
+      std::vector<int> actual(n, 3);
+      std::vector<int> last(actual);
+      last.back() = 4;
+
+      auto every = everyItem(equal(3));
+      auto every_par = everyItem(matcha::execution::par, equal(3));
+      run("EveryItem", "pass", n, [&] { return every.matches(actual); });
+      run("EveryItem", "fail", n, [&] { return every.matches(last); });
+      run("EveryItem", "render", n, [&] { return render(last, every); });
+      run("EveryItem<par>", "pass", n,
+        [&] { return every_par.matches(actual); });
+    }
+  }
+
+  void bench_batch()
+  {
+    for (std::size_t n : sizes) {
+      std::vector<int> column(n);
+      std::iota(column.begin(), column.end(), 0);
+
+      auto m = anyOf(lessThan(10), greaterThan(static_cast<int>(n) - 10));
+      run("matches_all<AnyOf>", "mixed", n,
+        [&] { return m.matches_all(column).count(); });
+
+      auto fused = anyOf(equal(1), equal(3), equal(5), equal(7));
+      run("matches_all<AnyOfEqual>", "mixed", n,
+        [&] { return fused.matches_all(column).count(); });
+    }
+  }
+
+}
+
+int main(int argc, char ** argv)
+{
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg(argv[i]);
+    if (arg.substr(0, 9) == "--filter=") {
+      opts.filter = std::string(arg.substr(9));
+    } else if (arg.substr(0, 11) == "--min-time=") {
+      opts.min_time = std::atof(argv[i] + 11);
+    } else {
+      std::fprintf(stderr,
+        "usage: %s [--filter=substring] [--min-time=seconds]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  {
+    writer out(std::cout);
+    out << "{\"context\":{\"compiler\":\""
+#if defined(__VERSION__)
+        << __VERSION__
+#endif
+        << "\",\"cplusplus\":" << static_cast<long>(__cplusplus)
+        << ",\"min_time\":" << opts.min_time << "}}\n";
+  }
+
+  bench_equal();
+  bench_approx();
+  bench_contain();
+  bench_strings();
+  bench_combinators();
+  bench_quantifiers();
+  bench_batch();
+}
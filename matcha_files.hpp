@@ -0,0 +1,722 @@
+#ifndef H_MATCHA_FILES
+#define H_MATCHA_FILES
+
+// Matchers over the contents of files, which the actual value names:
+//
+//   expect("out/report.csv", fileEquals("golden/report.csv"));
+//   expect("out/job.log", to(fileContain("finished")));
+//   expect("out/job.log", fileEndsWith("exit 0\n"));
+//
+// Files are mapped read-only and compared in place with the simd byte
+// kernels, so large outputs are never copied into memory. Where mapping
+// is not available or fails (pipes, special files, exhausted address
+// space), they are streamed through a fixed-size buffer instead. A file
+// that cannot be opened matches nothing.
+//
+// Line matchers read text incrementally, from a named file, an
+// std::istream or a file_descriptor, and stop at the first line that
+// decides the result:
+//
+//   expect(std::ifstream("big.log"), everyLine(startWith("20")));
+//   expect(file_descriptor{fd}, to(containLine(endWith("done"))));
+//   expect("out/report.csv", lineCount(equal(1001)));
+//
+// Lines are split at '\n' as std::getline does, and handed to the line
+// matcher as std::string_view into a fixed-size buffer (or the mapping),
+// so memory stays bounded by the longest line. Streams and descriptors
+// are read from their current position and cannot be rewound, so the
+// line that decided a failure is kept for its message.
+
+#include "matcha.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <istream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATCHA_FILES_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace matcha {
+
+#if defined(MATCHA_FILES_MMAP)
+  // An open POSIX file descriptor, such as a pipe, to match the lines read
+  // from it. It is neither closed nor rewound.
+  struct file_descriptor
+  {
+    int fd;
+  };
+#endif
+
+  namespace detail {
+
+    // Paths are strings, or anything converting to std::string such as
+    // std::filesystem::path on POSIX systems.
+    template<class P>
+    std::string file_path(const P & path)
+    {
+      if constexpr (is_string_like<P>::value) {
+        return std::string(as_string_view(path));
+      } else {
+        static_assert(std::is_convertible<const P &, std::string>::value,
+          "expects a path");
+        return std::string(path);
+      }
+    }
+
+    // A file opened for reading, mapped whole when the platform and the
+    // file allow it and read through stdio otherwise. next() hands out
+    // the contents in order either way: views into the mapping, or the
+    // caller's buffer filled by a read.
+    class input_file
+    {
+    public:
+      static constexpr std::size_t chunk = std::size_t(1) << 16;
+
+      explicit input_file(const std::string & path)
+      {
+#if defined(MATCHA_FILES_MMAP)
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+          struct stat st;
+          if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ == 0) {
+              mapped_ = true;
+            } else {
+              void * p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+              if (p != MAP_FAILED) {
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char *>(p);
+                mapped_ = true;
+              }
+            }
+          }
+          ::close(fd);
+          if (mapped_)
+            return;
+        }
+#endif
+        file_ = std::fopen(path.c_str(), "rb");
+      }
+
+      input_file(const input_file &) = delete;
+      input_file & operator=(const input_file &) = delete;
+
+      ~input_file()
+      {
+#if defined(MATCHA_FILES_MMAP)
+        if (data_ != nullptr)
+          ::munmap(const_cast<char *>(data_), size_);
+#endif
+        if (file_ != nullptr)
+          std::fclose(file_);
+      }
+
+      bool is_open() const { return mapped_ || file_ != nullptr; }
+
+      bool is_mapped() const { return mapped_; }
+
+      // The whole file, when it is mapped.
+      std::string_view contents() const {
+        return std::string_view(data_, size_);
+      }
+
+      // Up to n of the next bytes, fewer only at the end of the file.
+      std::string_view next(char * buffer, std::size_t n)
+      {
+        if (mapped_) {
+          const std::size_t k = std::min(n, size_ - offset_);
+          std::string_view v(data_ + offset_, k);
+          offset_ += k;
+          return v;
+        }
+        return std::string_view(buffer, read(buffer, n));
+      }
+
+      // Whether the file ends with suffix. Seekable files are compared
+      // from their end through a fixed buffer; others keep the last
+      // suffix.size() bytes of what streams by.
+      bool ends_with(std::string_view suffix)
+      {
+        const std::size_t n = suffix.size();
+        if (n == 0)
+          return true;
+        if (mapped_)
+          return n <= size_ && 
+            std::memcmp(data_ + size_ - n, suffix.data(), n) == 0;
+
+        if (std::fseek(file_, 0, SEEK_END) == 0) {
+          const long size = std::ftell(file_);
+          if (size >= 0) {
+            if (static_cast<unsigned long>(size) < n ||
+                std::fseek(file_, size - static_cast<long>(n), SEEK_SET) != 0)
+              return false;
+
+            char block[4096];
+            for (std::size_t at = 0; at < n; ) {
+              const std::size_t want = std::min(sizeof block, n - at);
+              if (read(block, want) != want || 
+                  std::memcmp(block, suffix.data() + at, want) != 0)
+                return false;
+              at += want;
+            }
+            return true;
+          }
+        }
+
+        std::vector<char> buffer(n);
+        std::vector<char> block(chunk);
+        std::size_t kept = 0;
+        for (;;) {
+          const std::size_t got = read(block.data(), chunk);
+          if (got >= n) {
+            std::memcpy(buffer.data(), block.data() + got - n, n);
+            kept = n;
+          } else if (got > 0) {
+            const std::size_t keep = std::min(kept, n - got);
+            std::memmove(buffer.data(), buffer.data() + kept - keep, keep);
+            std::memcpy(buffer.data() + keep, block.data(), got);
+            kept = keep + got;
+          }
+          if (got < chunk)
+            return kept == n &&
+              std::memcmp(buffer.data(), suffix.data(), n) == 0;
+        }
+      }
+
+    private:
+      std::size_t read(char * buffer, std::size_t n)
+      {
+        std::size_t got = 0;
+        while (got < n) {
+          const std::size_t k = std::fread(buffer + got, 1, n - got, file_);
+          if (k == 0)
+            break;
+          got += k;
+        }
+        return got;
+      }
+
+      const char * data_ = nullptr;
+      std::size_t size_ = 0;
+      std::size_t offset_ = 0;
+      bool mapped_ = false;
+      std::FILE * file_ = nullptr;
+    };
+
+    // Where two files first differ, walking both in step.
+    struct file_difference
+    {
+      enum { none, actual_ends, expected_ends, bytes, unreadable } kind;
+      std::size_t offset;
+    };
+
+    inline file_difference compare_files(input_file & a, input_file & e)
+    {
+      if (a.is_mapped() && e.is_mapped()) {
+        const std::string_view x = a.contents();
+        const std::string_view y = e.contents();
+        const std::size_t n = std::min(x.size(), y.size());
+        const std::size_t i = simd::mismatch_bytes(x.data(), y.data(), n);
+        if (i < n)
+          return {file_difference::bytes, i};
+        if (x.size() != y.size())
+          return {x.size() < y.size() ? file_difference::actual_ends
+                                      : file_difference::expected_ends, n};
+        return {file_difference::none, n};
+      }
+
+      std::vector<char> buffers(2 * input_file::chunk);
+      std::size_t offset = 0;
+      for (;;) {
+        const std::string_view x = a.next(buffers.data(), input_file::chunk);
+        const std::string_view y = e.next(buffers.data() + input_file::chunk,
+          input_file::chunk);
+        const std::size_t n = std::min(x.size(), y.size());
+        const std::size_t i = simd::mismatch_bytes(x.data(), y.data(), n);
+        if (i < n)
+          return {file_difference::bytes, offset + i};
+        if (x.size() != y.size())
+          return {x.size() < y.size() ? file_difference::actual_ends
+                                      : file_difference::expected_ends,
+                  offset + n};
+        if (n < input_file::chunk)
+          return {file_difference::none, offset + n};
+        offset += n;
+      }
+    }
+
+    inline file_difference compare_files(const std::string & actual,
+        const std::string & expected)
+    {
+      input_file a(actual);
+      input_file e(expected);
+      if (!a.is_open() || !e.is_open())
+        return {file_difference::unreadable, 0};
+      return compare_files(a, e);
+    }
+
+    // Whether the file holds needle. Streamed files keep the last
+    // needle.size() - 1 bytes of each chunk, so that occurrences spanning
+    // two chunks are found.
+    inline bool file_contains(input_file & f, std::string_view needle)
+    {
+      if (f.is_mapped())
+        return simd::search(f.contents(), needle) != std::string_view::npos;
+      if (needle.empty())
+        return true;
+
+      const std::size_t carry = needle.size() - 1;
+      std::vector<char> buffer(carry + input_file::chunk);
+      std::size_t kept = 0;
+      for (;;) {
+        const std::string_view got = f.next(buffer.data() + kept,
+          input_file::chunk);
+        const std::size_t have = kept + got.size();
+        if (simd::search(std::string_view(buffer.data(), have), needle) !=
+            std::string_view::npos)
+          return true;
+        if (got.size() < input_file::chunk)
+          return false;
+        kept = std::min(have, carry);
+        std::memmove(buffer.data(), buffer.data() + have - kept, kept);
+      }
+    }
+
+    // Hands f each line of the text, until f returns false.
+    template<class F>
+    void for_each_line(std::string_view text, F && f)
+    {
+      std::size_t first = 0;
+      while (first < text.size()) {
+        const std::size_t k = simd::find(text.data() + first,
+          text.size() - first, '\n');
+        if (!f(text.substr(first, k)))
+          return;
+        first += k + 1;
+      }
+    }
+
+    // Hands f each line of what read(buffer, n) fills in, until f returns
+    // false; read returns 0 only at the end. The partial line at the end
+    // of the buffer is moved to its front before the next read, and the
+    // buffer only grows for a line longer than itself. Newlines are only
+    // searched for once, in the bytes added since the last search.
+    template<class Read, class F>
+    void for_each_line(Read && read, F && f)
+    {
+      std::vector<char> buffer(input_file::chunk);
+      std::size_t first = 0;
+      std::size_t scanned = 0;
+      std::size_t last = 0;
+
+      for (;;) {
+        const std::size_t k = simd::find(buffer.data() + scanned,
+          last - scanned, '\n');
+        if (k < last - scanned) {
+          const std::size_t eol = scanned + k;
+          if (!f(std::string_view(buffer.data() + first, eol - first)))
+            return;
+          first = scanned = eol + 1;
+          continue;
+        }
+        scanned = last;
+
+        if (first > 0) {
+          std::memmove(buffer.data(), buffer.data() + first, last - first);
+          last -= first;
+          scanned = last;
+          first = 0;
+        } else if (last == buffer.size()) {
+          buffer.resize(2 * buffer.size());
+        }
+
+        const std::size_t got = read(buffer.data() + last,
+          buffer.size() - last);
+        if (got == 0) {
+          if (last > 0)
+            f(std::string_view(buffer.data(), last));
+          return;
+        }
+        last += got;
+      }
+    }
+
+    // Hands f each line of the file the actual value names, or of the
+    // stream or descriptor it is. False if it cannot be read.
+    template<class U, class F>
+    bool each_line(const U & actual, F && f)
+    {
+      if constexpr (std::is_base_of<std::istream, U>::value) {
+        std::streambuf * in = actual.rdbuf();
+        if (in == nullptr || actual.fail())
+          return false;
+        for_each_line([in](char * buffer, std::size_t n) {
+          return static_cast<std::size_t>(
+            in->sgetn(buffer, static_cast<std::streamsize>(n)));
+        }, f);
+#if defined(MATCHA_FILES_MMAP)
+      } else if constexpr (std::is_same<U, file_descriptor>::value) {
+        if (actual.fd < 0)
+          return false;
+        for_each_line([fd = actual.fd](char * buffer, std::size_t n) {
+          for (;;) {
+            const ssize_t got = ::read(fd, buffer, n);
+            if (got >= 0)
+              return static_cast<std::size_t>(got);
+            if (errno != EINTR)
+              return std::size_t(0);
+          }
+        }, f);
+#endif
+      } else {
+        input_file file(file_path(actual));
+        if (!file.is_open())
+          return false;
+        if (file.is_mapped()) {
+          for_each_line(file.contents(), f);
+        } else {
+          for_each_line([&file](char * buffer, std::size_t n) {
+            return file.next(buffer, n).size();
+          }, f);
+        }
+      }
+      return true;
+    }
+
+    // What the last line matcher evaluated on this thread read, and from
+    // which actual: how many lines, and the one it stopped at, if any, as
+    // the line before it was the last one read. The text is kept up to the
+    // failure message's byte budget.
+    struct line_scan
+    {
+      const void * actual = nullptr;
+      bool readable = true;
+      bool stopped = false;
+      std::size_t lines = 0;
+      std::string text;
+    };
+
+    inline line_scan & last_scan() {
+      static thread_local line_scan scan;
+      return scan;
+    }
+
+    // Reads lines until decisive(line) holds.
+    template<class U, class P>
+    const line_scan & scan_lines(const U & actual, const P & decisive)
+    {
+      line_scan & scan = last_scan();
+      scan.actual = &actual;
+      scan.stopped = false;
+      scan.lines = 0;
+      scan.text.clear();
+      scan.readable = each_line(actual, [&](std::string_view line) {
+        ++scan.lines;
+        if (!decisive(line))
+          return true;
+        scan.stopped = true;
+        scan.text.assign(line.data(),
+          std::min(line.size(), failure_limits().max_bytes));
+        return false;
+      });
+      return scan;
+    }
+
+    // The scan a failure message reports. Files named by path are read
+    // again, since the matcher may have been evaluated on another thread,
+    // under a parallel quantifier. Streams and descriptors cannot be, so
+    // they report this thread's last scan if it was of the same actual,
+    // and nothing otherwise.
+    template<class U, class P>
+    const line_scan * scan_to_report(const U & actual, const P & decisive)
+    {
+      constexpr bool single_pass = std::is_base_of<std::istream, U>::value
+#if defined(MATCHA_FILES_MMAP)
+        || std::is_same<U, file_descriptor>::value
+#endif
+        ;
+
+      if constexpr (single_pass)
+        return last_scan().actual == &actual ? &last_scan() : nullptr;
+      else
+        return &scan_lines(actual, decisive);
+    }
+
+    template<class T>
+    bool line_matches(std::string_view line, const T & expected) {
+      if constexpr (is_matcher<T>::value)
+        return expected.matches(line);
+      else
+        return line == as_string_view(expected);
+    }
+
+  }; // end detail
+
+  template<typename T>
+  struct FileEquals
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      return detail::compare_files(detail::file_path(actual), expected).kind
+        == detail::file_difference::none;
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "have the same contents as " << expected;
+    }
+
+    // The files are compared again, as matches() may have run on another
+    // thread.
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual,
+        const T & expected) const {
+      const detail::file_difference d =
+        detail::compare_files(detail::file_path(actual), expected);
+
+      switch (d.kind) {
+        case detail::file_difference::unreadable:
+          o << ", but the files cannot both be read";
+          break;
+        case detail::file_difference::actual_ends:
+          o << ", but ends after " << d.offset << " bytes";
+          break;
+        case detail::file_difference::expected_ends:
+          o << ", but goes on after " << d.offset << " bytes";
+          break;
+        case detail::file_difference::bytes:
+          o << ", but first differs at byte " << d.offset;
+          break;
+        case detail::file_difference::none:
+          break;
+      }
+    }
+  };
+
+  template<typename T>
+  struct FileContains
+  {
+    static_assert(detail::is_string_like<T>::value, "expects a string");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      detail::input_file f(detail::file_path(actual));
+      return f.is_open() &&
+        detail::file_contains(f, detail::as_string_view(expected));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "name a file containing " << expected;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, const T &) const {
+      if (!detail::input_file(detail::file_path(actual)).is_open())
+        o << ", but it cannot be read";
+    }
+  };
+
+  template<typename T>
+  struct FileEndsWith
+  {
+    static_assert(detail::is_string_like<T>::value, "expects a string");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      detail::input_file f(detail::file_path(actual));
+      return f.is_open() && f.ends_with(detail::as_string_view(expected));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << "name a file ending with " << expected;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual, const T &) const {
+      if (!detail::input_file(detail::file_path(actual)).is_open())
+        o << ", but it cannot be read";
+    }
+  };
+
+  template<typename T>
+  struct EveryLine
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    template<typename U>
+    bool matches(const U & actual, const T & item) const {
+      const detail::line_scan & scan = detail::scan_lines(actual,
+        [&](std::string_view line) { return !item.matches(line); });
+      return scan.readable && !scan.stopped;
+    }
+
+    void describe(writer& o, const T & item) const {
+      o << "every line " << item;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual,
+        const T & item) const {
+      const detail::line_scan * scan = detail::scan_to_report(actual,
+        [&](std::string_view line) { return !item.matches(line); });
+      if (scan == nullptr)
+        return;
+
+      if (!scan->readable) {
+        o << ", but it cannot be read";
+      } else if (scan->stopped) {
+        const std::string_view line = scan->text;
+        o << ", but line " << scan->lines << " was " << line;
+        item.describe_mismatch(o, line);
+      }
+    }
+  };
+
+  // Holds a line equal to the expected string, or matched by the expected
+  // line matcher.
+  template<typename T>
+  struct ContainsLine
+  {
+    static_assert(is_matcher<T>::value || detail::is_string_like<T>::value,
+      "expects a Matcher or a string");
+
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      const detail::line_scan & scan = detail::scan_lines(actual,
+        [&](std::string_view line) {
+          return detail::line_matches(line, expected);
+        });
+      return scan.readable && scan.stopped;
+    }
+
+    void describe(writer& o, const T & expected) const {
+      if constexpr (is_matcher<T>::value)
+        o << "contain a line " << expected;
+      else
+        o << "contain the line " << expected;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual,
+        const T & expected) const {
+      const detail::line_scan * scan = detail::scan_to_report(actual,
+        [&](std::string_view line) {
+          return detail::line_matches(line, expected);
+        });
+      if (scan == nullptr)
+        return;
+
+      if (!scan->readable)
+        o << ", but it cannot be read";
+      else
+        o << ", but has no such line among its " << scan->lines
+          << (scan->lines == 1 ? " line" : " lines");
+    }
+  };
+
+  template<typename T>
+  struct LineCount
+  {
+    static_assert(is_matcher<T>::value, "expects a Matcher argument");
+
+    template<typename U>
+    bool matches(const U & actual, const T & count) const {
+      const detail::line_scan & scan = detail::scan_lines(actual,
+        [](std::string_view) { return false; });
+      return scan.readable && count.matches(scan.lines);
+    }
+
+    void describe(writer& o, const T & count) const {
+      o << "have a line count " << count;
+    }
+
+    template<typename U>
+    void describe_mismatch(writer& o, const U & actual,
+        const T & count) const {
+      const detail::line_scan * scan = detail::scan_to_report(actual,
+        [](std::string_view) { return false; });
+      if (scan == nullptr)
+        return;
+
+      if (!scan->readable) {
+        o << ", but it cannot be read";
+      } else {
+        o << ", but has " << scan->lines
+          << (scan->lines == 1 ? " line" : " lines");
+        count.describe_mismatch(o, scan->lines);
+      }
+    }
+  };
+
+  namespace predicates {
+
+    inline auto fileEqual = [](auto && path) {
+      return make_matcher<FileEquals>(detail::file_path(path));
+    };
+
+    inline auto fileEquals = fileEqual;
+
+    inline auto fileContain = [](auto && value) {
+      return make_matcher<FileContains>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto fileContains = fileContain;
+
+    inline auto fileEndWith = [](auto && value) {
+      return make_matcher<FileEndsWith>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto fileEndsWith = fileEndWith;
+
+    template <class T>
+    auto everyLine(T && matcher) {
+      return make_matcher<EveryLine>(std::forward<T>(matcher));
+    }
+
+    inline auto containLine = [](auto && value) {
+      return make_matcher<ContainsLine>(std::forward<decltype(value)>(value));
+    };
+
+    inline auto containsLine = containLine;
+
+    template <class T>
+    auto lineCount(T && matcher) {
+      return make_matcher<LineCount>(std::forward<T>(matcher));
+    }
+
+  }; // end predicates
+
+}; // end matcha
+
+namespace pretty_print {
+
+  // Streams have been read by the time a failure is reported.
+  template<typename T>
+  struct formatter<T,
+    std::enable_if_t<std::is_base_of<std::ios_base, T>::value>>
+  {
+    static void format(writer & w, const T &)
+    {
+      w << "[stream]";
+    }
+  };
+
+#if defined(MATCHA_FILES_MMAP)
+  template<>
+  struct formatter<matcha::file_descriptor>
+  {
+    static void format(writer & w, const matcha::file_descriptor & d)
+    {
+      w << "[file descriptor " << d.fd << ']';
+    }
+  };
+#endif
+
+}; // end pretty_print
+
+#endif // H_MATCHA_FILES
@@ -0,0 +1,739 @@
+#ifndef H_MATCHA_RULES
+#define H_MATCHA_RULES
+
+// Matchers written as text, e.g. read from configuration files:
+//
+//   matcha::rule r("not(endWith(\"foo\")) and anyOf(equal(3), equal(5))");
+//   r.matches(5);                  // true
+//   r.matches(4);                  // false
+//   expect(5, satisfies(r));
+//
+// A rule is parsed once into a flat program that a small interpreter runs
+// against a matcha::value; evaluating it does not allocate.
+
+#include "matcha.hpp"
+
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <deque>
+#include <limits>
+#include <variant>
+
+namespace matcha {
+
+  // A dynamically typed value that rules are evaluated against: null, a
+  // boolean, an integer, a floating-point number or a string. Strings are
+  // viewed rather than copied, so a value never allocates and must not
+  // outlive the string it was made from.
+  class value
+  {
+  public:
+    typedef std::variant<std::nullptr_t, bool, std::int64_t, double,
+      std::string_view> storage;
+
+    value() : v_(nullptr) { }
+    value(std::nullptr_t) : v_(nullptr) { }
+
+    template<class T,
+      std::enable_if_t<std::is_arithmetic<T>::value, int> = 0>
+    value(T number) : v_(make_number(number)) { }
+
+    template<class T,
+      std::enable_if_t<detail::is_string_like<T>::value, int> = 0>
+    value(const T & s) : v_(detail::as_string_view(s)) { }
+
+    const storage & get() const { return v_; }
+
+    bool is_null() const { return std::holds_alternative<std::nullptr_t>(v_); }
+
+    // Null when the value is not a string.
+    const std::string_view * string() const {
+      return std::get_if<std::string_view>(&v_);
+    }
+
+    // Numbers compare by value whatever their representation, strings
+    // lexicographically; values of different kinds are never equal and
+    // never ordered.
+    friend bool operator==(const value & a, const value & b) {
+      return compare(a, b) == 0;
+    }
+
+    friend bool operator!=(const value & a, const value & b) {
+      return !(a == b);
+    }
+
+    friend bool operator<(const value & a, const value & b) {
+      return compare(a, b) == -1;
+    }
+
+    friend bool operator>(const value & a, const value & b) {
+      return compare(a, b) == 1;
+    }
+
+  private:
+    template<class T>
+    static storage make_number(T number)
+    {
+      if constexpr (std::is_same<T, bool>::value)
+        return number;
+      else if constexpr (std::is_floating_point<T>::value)
+        return static_cast<double>(number);
+      else if constexpr (std::is_unsigned<T>::value &&
+          sizeof(T) >= sizeof(std::int64_t))
+        return number > static_cast<T>(
+            std::numeric_limits<std::int64_t>::max())
+          ? storage(static_cast<double>(number))
+          : storage(static_cast<std::int64_t>(number));
+      else
+        return static_cast<std::int64_t>(number);
+    }
+
+    // -1, 0 or 1, or 2 when a and b do not compare (including NaN).
+    static int compare(const value & a, const value & b)
+    {
+      const std::size_t x = a.v_.index();
+      const std::size_t y = b.v_.index();
+
+      if (x == 2 && y == 2)
+        return order(*std::get_if<2>(&a.v_), *std::get_if<2>(&b.v_));
+      if ((x == 2 || x == 3) && (y == 2 || y == 3))
+        return order(a.as_double(), b.as_double());
+      if (x != y)
+        return 2;
+
+      switch (x) {
+        case 0:
+          return 0;
+        case 1:
+          return *std::get_if<1>(&a.v_) == *std::get_if<1>(&b.v_) ? 0 : 2;
+        default:
+          return order(*std::get_if<4>(&a.v_), *std::get_if<4>(&b.v_));
+      }
+    }
+
+    double as_double() const {
+      return v_.index() == 2 ? static_cast<double>(*std::get_if<2>(&v_))
+        : *std::get_if<3>(&v_);
+    }
+
+    template<class T>
+    static int order(const T & x, const T & y) {
+      return x < y ? -1 : y < x ? 1 : x == y ? 0 : 2;
+    }
+
+    storage v_;
+  };
+
+}; // end matcha
+
+namespace pretty_print {
+
+  template<>
+  struct formatter<matcha::value>
+  {
+    static void format(writer & w, const matcha::value & v)
+    {
+      std::visit([&](const auto & x) {
+        if constexpr (std::is_same<std::decay_t<decltype(x)>,
+            std::nullptr_t>::value)
+          w << "null";
+        else
+          w << x;
+      }, v.get());
+    }
+  };
+
+}; // end pretty_print
+
+namespace matcha {
+
+  // A matcher expression compiled from text. The grammar follows the
+  // predicates it names:
+  //
+  //   expr    := and ("or" and)*
+  //   and     := unary ("and" unary)*
+  //   unary   := "not" unary | "(" expr ")" | call
+  //   call    := to(expr) | be(expr) | have(expr) | anyOf(expr, ...)
+  //            | equal(literal) | lessThan(literal) | greaterThan(literal)
+  //            | oneOf(literal, ...) | null()
+  //            | startWith(string) | endWith(string)
+  //            | containSubstring(string) | matchRegex(string)
+  //   literal := integer | number | "string" | true | false | null
+  //
+  // with the same aliases as matcha::predicates (equals, startsWith, ...)
+  // and &&, || and ! for and, or and not. Rules evaluate and describe
+  // themselves as the matchers they name would, so a rule and the matcher
+  // written in code report failures in the same words; and/or operands of
+  // not, and, or and anyOf are described in parentheses, where the words
+  // alone would not tell how they group. Rules nest at most 256 deep.
+  //
+  // The program is a flat list of instructions over one boolean register:
+  // tests set it, and and/or/anyOf short-circuit with conditional jumps.
+  // Rules are immutable once built; copies share the program.
+  class rule
+  {
+  public:
+    explicit rule(std::string_view source);
+
+    bool matches(const value & actual) const;
+
+    const std::string & source() const { return program_->source; }
+    const std::string & description() const {
+      return program_->description;
+    }
+
+  private:
+    enum op_type : unsigned char {
+      equal, less, greater, null, one_of, starts_with, ends_with, contains,
+      regex, negate, jump_if_true, jump_if_false
+    };
+
+    // arg is a constant, pattern or jump target index; count is the number
+    // of constants one_of compares against.
+    struct instruction
+    {
+      op_type op;
+      std::uint32_t arg;
+      std::uint32_t count;
+    };
+
+    struct node
+    {
+      enum kind_type { test, negate, all, any, wrap };
+
+      kind_type kind;
+      instruction leaf;
+      std::vector<int> children;
+      const char * word;
+    };
+
+    struct program
+    {
+      std::string source;
+      std::string description;
+      std::vector<instruction> code;
+      std::vector<value> constants;
+      std::vector<pattern> patterns;
+      std::deque<std::string> strings;
+    };
+
+    class parser;
+
+    static void compile(const std::vector<node> & tree, int root,
+        program & p);
+    static void thread_jumps(std::vector<instruction> & code);
+    static void describe(writer & o, const std::vector<node> & tree,
+        int root, const program & p, bool operand = false);
+
+    static std::string_view constant(const program & p,
+        const instruction & in) {
+      return *p.constants[in.arg].string();
+    }
+
+    std::shared_ptr<const program> program_;
+  };
+
+  class rule::parser
+  {
+  public:
+    parser(std::string_view source, std::vector<node> & tree, program & p)
+      : src_(source)
+      , tree_(tree)
+      , program_(p)
+    { }
+
+    int parse()
+    {
+      int root = disjunction();
+      skip_space();
+      if (pos_ != src_.size())
+        error("unexpected input");
+      return root;
+    }
+
+  private:
+    [[noreturn]] void error(const std::string & what) const
+    {
+      throw std::invalid_argument("rule: " + what + " at offset " +
+        std::to_string(pos_) + " in \"" + std::string(src_) + '"');
+    }
+
+    void skip_space()
+    {
+      while (pos_ < src_.size() &&
+          std::isspace(static_cast<unsigned char>(src_[pos_])))
+        ++pos_;
+    }
+
+    // Consumes token if it comes next; words must not run on into an
+    // identifier.
+    bool accept(std::string_view token)
+    {
+      skip_space();
+      if (src_.substr(pos_, token.size()) != token)
+        return false;
+
+      const std::size_t end = pos_ + token.size();
+      if (is_word(token.back()) && end < src_.size() && is_word(src_[end]))
+        return false;
+
+      pos_ = end;
+      return true;
+    }
+
+    void expect(char c)
+    {
+      if (!accept(std::string_view(&c, 1)))
+        error(std::string("expected '") + c + '\'');
+    }
+
+    static bool is_word(char c) {
+      return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    int add(node n)
+    {
+      tree_.push_back(std::move(n));
+      return static_cast<int>(tree_.size() - 1);
+    }
+
+    int add_test(op_type op, std::uint32_t arg, std::uint32_t count = 0) {
+      return add(node{node::test, instruction{op, arg, count}, {}, nullptr});
+    }
+
+    int disjunction()
+    {
+      std::vector<int> children{conjunction()};
+      while (accept("or") || accept("||"))
+        children.push_back(conjunction());
+
+      if (children.size() == 1)
+        return children.front();
+      return add(node{node::any, {}, std::move(children), ""});
+    }
+
+    int conjunction()
+    {
+      std::vector<int> children{unary()};
+      while (accept("and") || accept("&&"))
+        children.push_back(unary());
+
+      if (children.size() == 1)
+        return children.front();
+      return add(node{node::all, {}, std::move(children), nullptr});
+    }
+
+    // Every level of nesting passes through here.
+    int unary()
+    {
+      if (++depth_ > max_depth)
+        error("rule nested too deeply");
+
+      int result;
+      if (accept("not") || accept("!")) {
+        result = add(node{node::negate, {}, {unary()}, nullptr});
+      } else if (accept("(")) {
+        result = disjunction();
+        expect(')');
+      } else {
+        result = call();
+      }
+
+      --depth_;
+      return result;
+    }
+
+    int call()
+    {
+      skip_space();
+      const std::size_t start = pos_;
+      while (pos_ < src_.size() && is_word(src_[pos_]))
+        ++pos_;
+      const std::string_view name = src_.substr(start, pos_ - start);
+
+      if (name.empty())
+        error("expected a matcher");
+      expect('(');
+
+      int result;
+      if (name == "to" || name == "be" || name == "have") {
+        const char * word = name == "to" ? "to "
+          : name == "be" ? "be " : "have ";
+        result = add(node{node::wrap, {}, {disjunction()}, word});
+      } else if (name == "anyOf") {
+        std::vector<int> children{disjunction()};
+        while (accept(","))
+          children.push_back(disjunction());
+        result = add(node{node::any, {}, std::move(children), "any of "});
+      } else if (name == "equal" || name == "equals") {
+        result = add_test(equal, literal());
+      } else if (name == "lessThan") {
+        result = add_test(less, literal());
+      } else if (name == "greaterThan") {
+        result = add_test(greater, literal());
+      } else if (name == "oneOf") {
+        std::uint32_t first = literal();
+        std::uint32_t count = 1;
+        for (; accept(","); ++count)
+          literal();
+        result = add_test(one_of, first, count);
+      } else if (name == "null") {
+        result = add_test(null, 0);
+      } else if (name == "startWith" || name == "startsWith") {
+        result = add_test(starts_with, string());
+      } else if (name == "endWith" || name == "endsWith") {
+        result = add_test(ends_with, string());
+      } else if (name == "containSubstring" ||
+          name == "containsSubstring") {
+        result = add_test(contains, string());
+      } else if (name == "matchRegex" || name == "matchesRegex") {
+        std::uint32_t index = string();
+        const std::string_view source =
+          *program_.constants[index].string();
+        program_.patterns.emplace_back(source);
+        result = add_test(regex,
+          static_cast<std::uint32_t>(program_.patterns.size() - 1));
+      } else {
+        pos_ = start;
+        error("unknown matcher " + std::string(name));
+      }
+
+      expect(')');
+      return result;
+    }
+
+    std::uint32_t add_constant(value v)
+    {
+      program_.constants.push_back(v);
+      return static_cast<std::uint32_t>(program_.constants.size() - 1);
+    }
+
+    std::uint32_t string()
+    {
+      skip_space();
+      if (pos_ >= src_.size() || src_[pos_] != '"')
+        error("expected a string");
+      return literal();
+    }
+
+    // Adds the literal at pos_ to the constants and returns its index.
+    std::uint32_t literal()
+    {
+      skip_space();
+      if (accept("true"))
+        return add_constant(true);
+      if (accept("false"))
+        return add_constant(false);
+      if (accept("null"))
+        return add_constant(nullptr);
+
+      if (pos_ < src_.size() && src_[pos_] == '"') {
+        std::string s;
+        for (++pos_; pos_ < src_.size() && src_[pos_] != '"'; ++pos_) {
+          char c = src_[pos_];
+          if (c == '\\' && ++pos_ < src_.size()) {
+            switch (src_[pos_]) {
+              case 'n': c = '\n'; break;
+              case 't': c = '\t'; break;
+              case 'r': c = '\r'; break;
+              case '0': c = '\0'; break;
+              default: c = src_[pos_]; break;
+            }
+          }
+          s += c;
+        }
+        if (pos_ >= src_.size())
+          error("unterminated string");
+        ++pos_;
+
+        program_.strings.push_back(std::move(s));
+        return add_constant(std::string_view(program_.strings.back()));
+      }
+
+      const char * first = src_.data() + pos_;
+      const char * last = src_.data() + src_.size();
+      const char * end = first;
+      if (end != last && (*end == '-' || *end == '+'))
+        ++end;
+      bool integral = true;
+      for (; end != last; ++end) {
+        if (*end == '.' || *end == 'e' || *end == 'E') {
+          integral = false;
+        } else if ((*end == '-' || *end == '+') &&
+            (end[-1] == 'e' || end[-1] == 'E')) {
+        } else if (!std::isdigit(static_cast<unsigned char>(*end))) {
+          break;
+        }
+      }
+
+      if (integral) {
+        std::int64_t n;
+        auto result = std::from_chars(first + (*first == '+'), end, n);
+        if (result.ec == std::errc() && result.ptr == end &&
+            end != first) {
+          pos_ += static_cast<std::size_t>(end - first);
+          return add_constant(n);
+        }
+      } else {
+        const std::string text(first, end);
+        char * parsed;
+        double d = std::strtod(text.c_str(), &parsed);
+        if (parsed == text.c_str() + text.size()) {
+          pos_ += text.size();
+          return add_constant(d);
+        }
+      }
+      error("expected a literal");
+    }
+
+    static constexpr int max_depth = 256;
+
+    std::string_view src_;
+    std::vector<node> & tree_;
+    program & program_;
+    std::size_t pos_ = 0;
+    int depth_ = 0;
+  };
+
+  inline rule::rule(std::string_view source)
+  {
+    auto p = std::make_shared<program>();
+    p->source = std::string(source);
+
+    std::vector<node> tree;
+    const int root = parser(p->source, tree, *p).parse();
+
+    compile(tree, root, *p);
+    thread_jumps(p->code);
+
+    writer o;
+    describe(o, tree, root, *p);
+    p->description = o.str();
+
+    program_ = std::move(p);
+  }
+
+  inline void rule::compile(const std::vector<node> & tree, int root,
+      program & p)
+  {
+    const node & n = tree[static_cast<std::size_t>(root)];
+
+    switch (n.kind) {
+      case node::test:
+        p.code.push_back(n.leaf);
+        break;
+      case node::negate:
+        compile(tree, n.children.front(), p);
+        p.code.push_back(instruction{negate, 0, 0});
+        break;
+      case node::wrap:
+        compile(tree, n.children.front(), p);
+        break;
+      case node::all:
+      case node::any: {
+        // Each operand but the last leaves the register as the result
+        // when it is decisive and jumps to the end.
+        const op_type jump = n.kind == node::all
+          ? jump_if_false : jump_if_true;
+        std::vector<std::size_t> exits;
+        for (std::size_t i = 0; i < n.children.size(); ++i) {
+          compile(tree, n.children[i], p);
+          if (i + 1 < n.children.size()) {
+            exits.push_back(p.code.size());
+            p.code.push_back(instruction{jump, 0, 0});
+          }
+        }
+        for (std::size_t exit : exits)
+          p.code[exit].arg = static_cast<std::uint32_t>(p.code.size());
+        break;
+      }
+    }
+  }
+
+  // Jumps that land on a jump taken under the same condition go straight
+  // to its target, and on one taken under the opposite condition just past
+  // it, so nested and/or chains leave in one step.
+  inline void rule::thread_jumps(std::vector<instruction> & code)
+  {
+    for (instruction & in : code) {
+      if (in.op != jump_if_true && in.op != jump_if_false)
+        continue;
+      while (in.arg < code.size()) {
+        const instruction & next = code[in.arg];
+        if (next.op == in.op)
+          in.arg = next.arg;
+        else if (next.op == jump_if_true || next.op == jump_if_false)
+          ++in.arg;
+        else
+          break;
+      }
+    }
+  }
+
+  // operand is set for the operands of not, and, or and anyOf, and
+  // carried through to, be and have.
+  inline void rule::describe(writer & o, const std::vector<node> & tree,
+      int root, const program & p, bool operand)
+  {
+    const node & n = tree[static_cast<std::size_t>(root)];
+
+    switch (n.kind) {
+      case node::test: {
+        const instruction & in = n.leaf;
+        switch (in.op) {
+          case equal:
+            IsEqual<value>().describe(o, p.constants[in.arg]);
+            break;
+          case less:
+            IsLessThan<value>().describe(o, p.constants[in.arg]);
+            break;
+          case greater:
+            IsGreaterThan<value>().describe(o, p.constants[in.arg]);
+            break;
+          case null:
+            IsNull<>().describe(o);
+            break;
+          case one_of:
+            o << "one of (" << p.constants[in.arg];
+            for (std::uint32_t i = 1; i < in.count; ++i)
+              o << ", " << p.constants[in.arg + i];
+            o << ')';
+            break;
+          case starts_with:
+            StartsWith<std::string_view>().describe(o, constant(p, in));
+            break;
+          case ends_with:
+            EndsWith<std::string_view>().describe(o, constant(p, in));
+            break;
+          case contains:
+            ContainsSubstring<std::string_view>().describe(o, constant(p, in));
+            break;
+          case regex:
+            MatchesRegex<pattern>().describe(o, p.patterns[in.arg]);
+            break;
+          default:
+            break;
+        }
+        break;
+      }
+      case node::negate:
+        o << "not ";
+        describe(o, tree, n.children.front(), p, true);
+        break;
+      case node::wrap:
+        o << n.word;
+        describe(o, tree, n.children.front(), p, operand);
+        break;
+      case node::all:
+      case node::any:
+        if (operand)
+          o << '(';
+        if (n.word != nullptr)
+          o << n.word;
+        for (std::size_t i = 0; i < n.children.size(); ++i) {
+          if (i > 0)
+            o << (n.kind == node::all ? " and " : " or ");
+          describe(o, tree, n.children[i], p, true);
+        }
+        if (operand)
+          o << ')';
+        break;
+    }
+  }
+
+  // Tests apply the predicates the rule names, so a rule and a matcher
+  // agree on what matches; string tests fail on values that are not
+  // strings. Tests and jumps share one dispatch.
+  inline bool rule::matches(const value & actual) const
+  {
+    const program & p = *program_;
+    const std::size_t size = p.code.size();
+    const std::string_view * s = actual.string();
+
+    bool result = false;
+    std::size_t pc = 0;
+    while (pc < size) {
+      const instruction & in = p.code[pc++];
+
+      switch (in.op) {
+        case equal:
+          result = IsEqual<value>().matches(actual, p.constants[in.arg]);
+          break;
+        case less:
+          result = IsLessThan<value>().matches(actual, p.constants[in.arg]);
+          break;
+        case greater:
+          result = IsGreaterThan<value>().matches(actual,
+            p.constants[in.arg]);
+          break;
+        case null:
+          result = actual.is_null();
+          break;
+        case one_of: {
+          auto first = p.constants.begin() + in.arg;
+          result = std::find(first, first + in.count, actual) !=
+            first + in.count;
+          break;
+        }
+        case starts_with:
+          result = s &&
+            StartsWith<std::string_view>().matches(*s, constant(p, in));
+          break;
+        case ends_with:
+          result = s &&
+            EndsWith<std::string_view>().matches(*s, constant(p, in));
+          break;
+        case contains:
+          result = s &&
+            ContainsSubstring<std::string_view>().matches(*s, constant(p, in));
+          break;
+        case regex:
+          result = s &&
+            MatchesRegex<pattern>().matches(*s, p.patterns[in.arg]);
+          break;
+        case negate:
+          result = !result;
+          break;
+        case jump_if_true:
+          if (result)
+            pc = in.arg;
+          break;
+        case jump_if_false:
+          if (!result)
+            pc = in.arg;
+          break;
+      }
+    }
+    return result;
+  }
+
+  template<typename T>
+  struct MatchesRule
+  {
+    template<typename U>
+    bool matches(const U & actual, const T & expected) const {
+      static_assert(std::is_constructible<value, const U &>::value,
+        "expects null, a boolean, a number or a string");
+
+      return expected.matches(value(actual));
+    }
+
+    void describe(writer& o, const T & expected) const {
+      o << expected.description();
+    }
+  };
+
+  namespace predicates {
+
+    inline auto satisfy = [](auto && r) {
+      return make_matcher<MatchesRule>(rule(std::forward<decltype(r)>(r)));
+    };
+
+    inline auto satisfies = satisfy;
+
+  }; // end predicates
+
+}; // end matcha
+
+#endif // H_MATCHA_RULES
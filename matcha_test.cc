@@ -0,0 +1,1167 @@
+// Regression tests for the matcher engines whose behaviour is not visible
+// from the demos: the regex DFA, the thread pool and reporters, the file
+// readers, the rule compiler, and the failure messages and limits of the
+// larger matchers.
+//
+// Build and run:
+//   g++ -std=c++17 -O2 -pthread matcha_test.cc -o matcha_test
+//   ./matcha_test [--filter=substring]
+//
+// Prints one line per failed check and exits with a non-zero status if
+// any failed. Randomized tests use fixed seeds, so failures reproduce.
+
+#include "matcha.hpp"
+#include "matcha_files.hpp"
+#include "matcha_rules.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <forward_list>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+  using namespace matcha::predicates;
+  using matcha::writer;
+
+  int failures = 0;
+
+  void check(bool ok, const char * what, const char * file, unsigned line)
+  {
+    if (!ok) {
+      std::printf("%s:%u: check failed: %s\n", file, line, what);
+      ++failures;
+    }
+  }
+
+#define CHECK(...) check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, \
+  __FILE__, __LINE__)
+
+  // The failure message expect() would report, without the trailing
+  // newline, or an empty string if the matcher matches.
+  template<class T, class M>
+  std::string message(const T & actual, M && matcher)
+  {
+    if (matcher.matches(actual))
+      return std::string();
+
+    matcha::print_limits limits = matcha::failure_limits();
+    limits.focus = matcher.mismatch_index(actual);
+
+    writer out;
+    out.limit(limits);
+    out << "expected " << actual << ' ' << matcher;
+    matcher.describe_mismatch(out, actual);
+    return std::string(out.view());
+  }
+
+#define CHECK_MESSAGE(actual, matcher, expected) \
+  check(message(actual, matcher) == (expected), \
+    #matcher " reports " #expected, __FILE__, __LINE__)
+
+  // Regular expressions
+
+  // Random patterns over a and b, with only the constructs on which the
+  // engine and ECMAScript std::regex_match agree.
+  struct pattern_generator
+  {
+    std::mt19937 & rng;
+
+    int below(int n) { return static_cast<int>(rng() % unsigned(n)); }
+
+    std::string atom(int depth)
+    {
+      static const char * const atoms[] = { "a", "b", ".", "[ab]", "[^a]" };
+      if (depth > 0 && below(4) == 0)
+        return "(" + alternation(depth - 1) + ")";
+      return atoms[below(5)];
+    }
+
+    std::string piece(int depth)
+    {
+      static const char * const quantifiers[] = { "*", "+", "?", "{1,2}",
+        "{2}" };
+      std::string s = atom(depth);
+      if (below(3) == 0)
+        s += quantifiers[below(5)];
+      return s;
+    }
+
+    std::string alternation(int depth)
+    {
+      std::string s;
+      for (int i = 0, n = 1 + below(3); i < n; ++i)
+        s += piece(depth);
+      if (below(3) == 0)
+        s += "|" + alternation(depth);
+      return s;
+    }
+  };
+
+  void test_regex_random()
+  {
+    std::mt19937 rng(8);
+    pattern_generator generate{rng};
+
+    for (int i = 0; i < 3000; ++i) {
+      const std::string source = generate.alternation(2);
+      const matcha::pattern p(source);
+      const std::regex reference(source);
+
+      for (int j = 0; j < 30; ++j) {
+        std::string input;
+        for (int k = 0, n = generate.below(8); k < n; ++k)
+          input += "abc"[generate.below(3)];
+        if (p.matches(input) != std::regex_match(input, reference)) {
+          std::printf("  pattern \"%s\", input \"%s\"\n", source.c_str(),
+            input.c_str());
+          CHECK(p.matches(input) == std::regex_match(input, reference));
+        }
+      }
+    }
+  }
+
+  void test_regex_byte_classes()
+  {
+    const matcha::pattern any("."), digit("\\d"), word("\\w"),
+      space("\\s"), not_digit("\\D"), negated("[^a-c]"), hex("\\x41"),
+      range("[\\x80-\\xff]");
+
+    for (int c = 0; c < 256; ++c) {
+      const std::string s(1, static_cast<char>(c));
+      const bool is_digit = c >= '0' && c <= '9';
+      const bool is_word = is_digit || c == '_' ||
+        (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+      const bool is_space = c == ' ' || (c >= '\t' && c <= '\r');
+
+      CHECK(any.matches(s) == (c != '\n'));
+      CHECK(digit.matches(s) == is_digit);
+      CHECK(not_digit.matches(s) == !is_digit);
+      CHECK(word.matches(s) == is_word);
+      CHECK(space.matches(s) == is_space);
+      CHECK(negated.matches(s) == (c < 'a' || c > 'c'));
+      CHECK(hex.matches(s) == (c == 'A'));
+      CHECK(range.matches(s) == (c >= 0x80));
+    }
+  }
+
+  void test_regex_anchors()
+  {
+    CHECK(matcha::pattern("^ab$").matches("ab"));
+    CHECK(!matcha::pattern("^ab$").matches("abb"));
+    CHECK(matcha::pattern("(^a|b)c").matches("ac"));
+    CHECK(matcha::pattern("(^a|b)c").matches("bc"));
+    CHECK(!matcha::pattern("a^b").matches("ab"));
+    CHECK(!matcha::pattern("a$b").matches("ab"));
+    CHECK(matcha::pattern("a$|ab").matches("ab"));
+    CHECK(matcha::pattern("^$").matches(""));
+    CHECK(!matcha::pattern("^$").matches("a"));
+    CHECK(matcha::pattern("(a|^)*b").matches("aab"));
+  }
+
+  // Patterns whose DFA has far more states than the cache holds step the
+  // NFA past the limit and must still give the same answers.
+  void test_regex_cache_overflow()
+  {
+    const char * const source = "(a|b)*a(a|b)(a|b)(a|b)(a|b)";
+    const std::regex reference(source);
+    const matcha::pattern tiny(source, 2), small(source, 8), full(source);
+
+    for (unsigned bits = 0; bits < (1u << 12); ++bits) {
+      for (std::size_t n : { std::size_t(5), std::size_t(9),
+                             std::size_t(12) }) {
+        std::string input;
+        for (std::size_t k = 0; k < n; ++k)
+          input += (bits >> k) & 1 ? 'a' : 'b';
+        const bool expected = std::regex_match(input, reference);
+        CHECK(tiny.matches(input) == expected);
+        CHECK(small.matches(input) == expected);
+        CHECK(full.matches(input) == expected);
+      }
+    }
+  }
+
+  // Copies share one cache, filled concurrently by threads that read the
+  // transitions others publish.
+  void test_regex_threads()
+  {
+    const char * const source = "([ab]*c[ab]{3}|d+)e?";
+    const std::regex reference(source);
+    const matcha::pattern shared(source, 64);
+
+    std::vector<std::string> inputs;
+    std::vector<char> expected;
+    std::mt19937 rng(14);
+    for (int i = 0; i < 2000; ++i) {
+      std::string input;
+      for (int k = 0, n = static_cast<int>(rng() % 12); k < n; ++k)
+        input += "abcde"[rng() % 5];
+      expected.push_back(std::regex_match(input, reference));
+      inputs.push_back(std::move(input));
+    }
+
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; ++t) {
+      threads.emplace_back([&, t, p = shared] {
+        for (std::size_t i = t; i < inputs.size() * 4; i += 3) {
+          const std::size_t k = i % inputs.size();
+          if (p.matches(inputs[k]) != (expected[k] != 0))
+            ++wrong;
+        }
+      });
+    }
+    for (auto & thread : threads)
+      thread.join();
+    CHECK(wrong.load() == 0);
+  }
+
+  bool rejects(const std::string & source)
+  {
+    try {
+      matcha::pattern p(source);
+    } catch (const std::invalid_argument &) {
+      return true;
+    }
+    return false;
+  }
+
+  // Malformed patterns, and ones nested too deeply to compile on the
+  // stack, are reported as parse errors.
+  void test_regex_errors()
+  {
+    CHECK(rejects("(a"));
+    CHECK(rejects("a)"));
+    CHECK(rejects("a{3,2}"));
+    CHECK(rejects("[a"));
+    CHECK(rejects("(?=a)"));
+
+    const std::string deep = std::string(20000, '(') + "a" +
+      std::string(20000, ')');
+    CHECK(rejects(deep));
+    CHECK(rejects("a" + std::string(100000, '*')));
+    CHECK(rejects(std::string(20000, '(')));
+
+    const std::string nested = std::string(200, '(') + "a" +
+      std::string(200, ')');
+    CHECK(!rejects(nested));
+    CHECK(matcha::pattern(nested).matches("a"));
+  }
+
+  // Batch evaluation
+
+  // Every bit of matches_all agrees with matches on the same value.
+  template<class M, class U>
+  bool same_as_matches(const M & matcher, const std::vector<U> & values)
+  {
+    const matcha::match_mask mask = matcher.matches_all(values);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      if (mask[i] != matcher.matches(values[i]))
+        return false;
+    }
+    return true;
+  }
+
+  void test_matches_all()
+  {
+    std::vector<double> reals;
+    std::vector<int> ints;
+    std::vector<long long> longs;
+    std::mt19937 rng(9);
+    for (int i = 0; i < 300; ++i) {
+      const int k = static_cast<int>(rng() % 13) - 6;
+      reals.push_back(k + static_cast<int>(rng() % 5) * 0.25);
+      ints.push_back(k);
+      longs.push_back(k + (rng() % 7 == 0 ? (1ll << 32) : 0));
+    }
+
+    CHECK(same_as_matches(equal(3), reals));
+    CHECK(same_as_matches(equal(-3), reals));
+    CHECK(same_as_matches(equal(2.5), ints));
+    CHECK(same_as_matches(equal(3.0f), reals));
+    CHECK(same_as_matches(equal(3), longs));
+    CHECK(same_as_matches(equal(3ll), ints));
+    CHECK(same_as_matches(lessThan(2), reals));
+    CHECK(same_as_matches(greaterThan(1.5), ints));
+    CHECK(same_as_matches(be(not(equal(0))), reals));
+    CHECK(same_as_matches(anyOf(equal(3), equal(5)), reals));
+    CHECK(same_as_matches(anyOf(equal(3), equal(2.5)), ints));
+    CHECK(same_as_matches(anyOf(equal(3), equal(-2ll)), longs));
+
+    CHECK(equal(3).matches(3.5));
+    CHECK(equal(3).matches_all(std::vector<double>{ 3.5 })[0]);
+    CHECK(anyOf(equal(3), equal(5)).matches(5.2));
+    CHECK(anyOf(equal(3), equal(5)).matches_all(
+      std::vector<double>{ 5.2 })[0]);
+  }
+
+  // Thread pool and item quantifiers
+
+  // A pool of its own, so that chunks are shared out and stolen even on a
+  // single core, where the shared pool has no workers.
+  void test_thread_pool_chunks()
+  {
+    matcha::detail::thread_pool pool(3);
+    CHECK(pool.slots() == 4);
+
+    for (std::size_t chunks : { 0, 1, 3, 4, 17, 1000 }) {
+      std::vector<std::atomic<int>> runs(chunks);
+      std::vector<std::atomic<int>> busy(pool.slots());
+      std::atomic<int> shared_slot(0);
+
+      auto body = [&](std::size_t chunk, unsigned slot) {
+        if (slot >= pool.slots() || busy[slot]++ != 0)
+          ++shared_slot;
+        ++runs[chunk];
+        if (chunk % 3 == 0)
+          std::this_thread::yield();
+        --busy[slot];
+      };
+      pool.run(chunks, body);
+
+      for (auto & r : runs)
+        CHECK(r.load() == 1);
+      CHECK(shared_slot.load() == 0);
+    }
+  }
+
+  void test_thread_pool_nesting_and_errors()
+  {
+    matcha::detail::thread_pool pool(3);
+
+    std::atomic<int> inner(0);
+    auto nested = [&](std::size_t, unsigned) {
+      auto body = [&](std::size_t, unsigned slot) {
+        CHECK(slot == 0);
+        ++inner;
+      };
+      pool.run(5, body);
+    };
+    pool.run(8, nested);
+    CHECK(inner.load() == 40);
+
+    auto throwing = [](std::size_t chunk, unsigned) {
+      if (chunk == 11)
+        throw std::runtime_error("chunk 11");
+    };
+    bool thrown = false;
+    try {
+      pool.run(64, throwing);
+    } catch (const std::runtime_error &) {
+      thrown = true;
+    }
+    CHECK(thrown);
+
+    std::atomic<int> after(0);
+    auto count = [&](std::size_t, unsigned) { ++after; };
+    pool.run(100, count);
+    CHECK(after.load() == 100);
+  }
+
+  // The parallel search reports the first decisive item, whichever chunk
+  // finds one first.
+  void test_find_item()
+  {
+    std::mt19937 rng(10);
+    for (int i = 0; i < 200; ++i) {
+      std::vector<int> v(1 + rng() % 5000, 1);
+      std::size_t first = matcha::detail::no_item;
+      for (int k = 0, n = static_cast<int>(rng() % 4); k < n; ++k) {
+        const std::size_t at = rng() % v.size();
+        v[at] = 9;
+        first = std::min(first, at);
+      }
+
+      const matcha::execution_policy policy{ true, 1 + rng() % 300 };
+      CHECK(matcha::detail::find_item(v, lessThan(5), false, policy) ==
+        first);
+      CHECK(matcha::detail::find_item(v, equal(9), true, policy) == first);
+      CHECK(everyItem(policy, lessThan(5)).matches(v) ==
+        (first == matcha::detail::no_item));
+    }
+
+    std::vector<int> v(100, 1);
+    v[37] = v[80] = 9;
+    const matcha::print_limits saved = matcha::failure_limits();
+    matcha::failure_limits().max_elements = 4;
+    CHECK_MESSAGE(v, everyItem(matcha::execution::par, lessThan(5)),
+      "expected [1, ..., 1, 9, ..., 1] every item less than 5, but item 37 "
+      "was 9");
+    CHECK_MESSAGE(v, noItem(matcha::execution::par, equal(9)),
+      "expected [1, ..., 1, 9, ..., 1] no item equal 9, but item 37 was 9");
+    matcha::failure_limits() = saved;
+  }
+
+  // Asynchronous reporting
+
+  // Messages from several threads, some wrapping around their 64-byte
+  // rings and some larger than a ring, arrive whole and in order per
+  // thread.
+  void test_async_reporter_order()
+  {
+    const unsigned threads = 4;
+    const int count = 3000;
+    std::ostringstream out;
+    {
+      matcha::async_reporter reporter(out, 64);
+      std::vector<std::thread> producers;
+      for (unsigned t = 0; t < threads; ++t) {
+        producers.emplace_back([&reporter, t] {
+          for (int i = 0; i < count; ++i) {
+            std::string line = std::to_string(t) + " " + std::to_string(i);
+            if (i % 97 == 0)
+              line.append(100, 'x');
+            reporter.report(line + "\n");
+          }
+        });
+      }
+      for (auto & producer : producers)
+        producer.join();
+    }
+
+    std::vector<int> next(threads, 0);
+    std::istringstream lines(out.str());
+    std::string line;
+    bool whole = true;
+    while (std::getline(lines, line)) {
+      unsigned t = 0;
+      int i = -1;
+      char rest[128] = "";
+      if (std::sscanf(line.c_str(), "%u %d%127s", &t, &i, rest) < 2 ||
+          t >= threads || i != next[t] ||
+          std::strlen(rest) != (i % 97 == 0 ? 100u : 0u)) {
+        whole = false;
+        break;
+      }
+      ++next[t];
+    }
+    CHECK(whole);
+    for (unsigned t = 0; t < threads; ++t)
+      CHECK(next[t] == count);
+  }
+
+  // flush() returns once earlier reports are written, and a reporter that
+  // takes the place of a destroyed one on the same thread gets a ring of
+  // its own.
+  void test_async_reporter_flush()
+  {
+    std::ostringstream first;
+    {
+      matcha::async_reporter reporter(first);
+      reporter.report("one\n");
+      reporter.flush();
+      CHECK(first.str() == "one\n");
+    }
+
+    std::ostringstream second;
+    {
+      matcha::async_reporter reporter(second);
+      reporter.report("two\n");
+      reporter.flush();
+      CHECK(second.str() == "two\n");
+
+      matcha::reporter * previous = matcha::set_reporter(&reporter);
+      matcha::expect(1, equal(2));
+      reporter.flush();
+      matcha::set_reporter(previous);
+      CHECK(second.str() == "two\nexpected 1 equal 2\n");
+    }
+    CHECK(first.str() == "one\n");
+  }
+
+  // Sequence differences
+
+  void test_edit_script()
+  {
+    const std::vector<int> a{ 1, 2, 3, 4, 5, 6 }, b{ 1, 2, 9, 4, 6, 7 };
+    const char * const script = ", differs at index 2: 3 instead of 9; at "
+      "index 4: extra [5]; at index 6: missing [7]";
+    CHECK_MESSAGE(a, equal(b), "expected [1, 2, 3, 4, 5, 6] equal "
+      "[1, 2, 9, 4, 6, 7]" + std::string(script));
+
+    const std::list<int> la(a.begin(), a.end()), lb(b.begin(), b.end());
+    CHECK_MESSAGE(la, equal(lb), "expected [1, 2, 3, 4, 5, 6] equal "
+      "[1, 2, 9, 4, 6, 7]" + std::string(script));
+
+    CHECK_MESSAGE((std::vector<int>{ 1, 2, 3 }),
+      equal(std::vector<int>{ 1, 2, 3, 4, 5 }),
+      "expected [1, 2, 3] equal [1, 2, 3, 4, 5], differs at index 3: "
+      "missing [4, 5]");
+    CHECK_MESSAGE((std::vector<int>{ 1, 2, 3, 4, 5 }),
+      equal(std::vector<int>{ 1, 7, 8, 5 }),
+      "expected [1, 2, 3, 4, 5] equal [1, 7, 8, 5], differs at index 1: "
+      "[2, 3, 4] instead of [7, 8]");
+    CHECK_MESSAGE(std::string("kitten"), equal(std::string("sitting")),
+      "expected kitten equal sitting, differs at index 0: k instead of s; "
+      "at index 4: e instead of i; at index 6: missing [g]");
+  }
+
+  // Scripts longer than max_edits, and node-based sequences with too much
+  // left after the first difference, are reported by that difference.
+  void test_edit_script_limits()
+  {
+    const matcha::print_limits saved = matcha::failure_limits();
+    matcha::failure_limits().max_elements = 4;
+
+    std::vector<int> x(1000), y(1000);
+    for (int i = 0; i < 1000; ++i) {
+      x[i] = i;
+      y[i] = i < 10 ? i : i + 1000;
+    }
+    CHECK_MESSAGE(x, equal(y),
+      "expected [0, ..., 9, 10, ..., 999] equal [0, ..., 9, 1010, ..., "
+      "1999], first mismatch at index 10: 10 instead of 1010, and more than "
+      "128 edits in all");
+
+    // 63 replacements, 126 edits, are still listed up to the limit.
+    for (int i = 0; i < 1000; ++i)
+      y[i] = i % 16 == 0 ? -1 : i;
+    CHECK_MESSAGE(x, equal(y), "expected [0, 1, ..., 999] equal [-1, 1, "
+      "..., 999], differs at index 0: 0 instead of -1; at index 16: 16 "
+      "instead of -1; and 61 more");
+
+    std::list<int> a(100000, 1), b(100000, 1);
+    *std::next(b.begin(), 5) = 2;
+    CHECK_MESSAGE(a, equal(b), "expected [1, 1, ..., 1, 1] equal [1, 1, "
+      "..., 1, 1], first mismatch at index 5: 1 instead of 2, with more "
+      "than 512 elements after it");
+
+    const std::forward_list<int> f{ 1, 2 }, g(2000, 1);
+    CHECK_MESSAGE(f, equal(g), "expected [1, 2] equal [1, 1, 1, 1, ...], "
+      "first mismatch at index 1: 2 instead of 1, with more than 512 "
+      "elements after it");
+
+    std::list<int> c(600, 1), d(600, 1);
+    d.back() = 3;
+    CHECK_MESSAGE(c, equal(d), "expected [1, 1, ..., 1, 1] equal [1, 1, "
+      "..., 1, 3], differs at index 599: 1 instead of 3");
+
+    matcha::failure_limits() = saved;
+  }
+
+  // Unordered comparison
+
+  // The squares of [0, n), computed as the iterator is dereferenced.
+  struct squares
+  {
+    int n;
+
+    struct const_iterator
+    {
+      typedef std::forward_iterator_tag iterator_category;
+      typedef int value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef void pointer;
+      typedef int reference;
+
+      int i;
+
+      int operator*() const { return i * i; }
+      const_iterator & operator++() { ++i; return *this; }
+      const_iterator operator++(int) {
+        const_iterator t = *this;
+        ++i;
+        return t;
+      }
+      bool operator==(const const_iterator & o) const { return i == o.i; }
+      bool operator!=(const const_iterator & o) const { return i != o.i; }
+    };
+
+    const_iterator begin() const { return const_iterator{ 0 }; }
+    const_iterator end() const { return const_iterator{ n }; }
+  };
+
+  // Expected elements that are proxies or computed values are counted as
+  // copies, not as addresses of temporaries.
+  void test_unordered_temporaries()
+  {
+    const std::vector<bool> a{ true, false, true, true },
+      b{ true, true, false, true }, c{ false, false, true, true };
+    CHECK(equalIgnoringOrder(b).matches(a));
+    CHECK_MESSAGE(a, equalIgnoringOrder(c), "expected [true, false, true, "
+      "true] equal ignoring order [false, false, true, true], has extra "
+      "[true] and is missing [false]");
+    CHECK(containsAll(std::vector<bool>{ false, true }).matches(a));
+    CHECK(!containsAll(std::vector<bool>{ false, false }).matches(a));
+    CHECK(containsInAnyOrder(true, true, false, true).matches(a));
+    CHECK(!containsInAnyOrder(true, false, false, true).matches(a));
+
+    const std::vector<int> w{ 9, 4, 1, 0, 16 }, x{ 16, 9, 4, 2, 0 };
+    CHECK(equalIgnoringOrder(squares{ 5 }).matches(w));
+    CHECK(containsAll(squares{ 4 }).matches(w));
+    CHECK_MESSAGE(x, equalIgnoringOrder(squares{ 5 }), "expected [16, 9, 4, "
+      "2, 0] equal ignoring order [0, 1, 4, 9, 16], has extra [2] and is "
+      "missing [1]");
+  }
+
+  // Files
+
+  // A file in the temporary directory, removed again on destruction.
+  class temp_file
+  {
+  public:
+    explicit temp_file(const std::string & contents)
+      : path_((std::filesystem::temp_directory_path() / ("matcha_test_" +
+          std::to_string(counter()++))).string())
+    {
+      std::ofstream out(path_, std::ios::binary);
+      out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+
+    ~temp_file() { std::remove(path_.c_str()); }
+
+    const std::string & path() const { return path_; }
+
+  private:
+    static int & counter() {
+      static int n = 0;
+      return n;
+    }
+
+    std::string path_;
+  };
+
+#if defined(MATCHA_FILES_MMAP)
+  // A pipe fed by a thread of its own and named through /proc, so that
+  // the matchers read it as a stream, chunk by chunk, instead of mapping
+  // it. It can be opened once.
+  class pipe_file
+  {
+  public:
+    explicit pipe_file(std::string contents)
+    {
+      int fds[2];
+      if (::pipe(fds) != 0)
+        throw std::runtime_error("pipe");
+      read_ = fds[0];
+      writer_ = std::thread([fd = fds[1], data = std::move(contents)] {
+        for (std::size_t at = 0; at < data.size(); ) {
+          const ssize_t k = ::write(fd, data.data() + at, data.size() - at);
+          if (k <= 0)
+            break;
+          at += static_cast<std::size_t>(k);
+        }
+        ::close(fd);
+      });
+    }
+
+    ~pipe_file() {
+      ::close(read_);
+      writer_.join();
+    }
+
+    std::string path() const {
+      return "/proc/self/fd/" + std::to_string(read_);
+    }
+
+    matcha::file_descriptor descriptor() const { return { read_ }; }
+
+  private:
+    int read_;
+    std::thread writer_;
+  };
+#endif
+
+  void test_file_matchers()
+  {
+    const temp_file a("hello world\n"), b("hello world\n"),
+      c("hello there\n"), d("hello"), e("hello world\n!!");
+    const std::string missing = a.path() + ".missing";
+
+    CHECK(fileEquals(b.path()).matches(a.path()));
+    CHECK_MESSAGE(c.path(), fileEquals(a.path()), "expected " + c.path() +
+      " have the same contents as " + a.path() +
+      ", but first differs at byte 6");
+    CHECK_MESSAGE(d.path(), fileEquals(a.path()), "expected " + d.path() +
+      " have the same contents as " + a.path() + ", but ends after 5 bytes");
+    CHECK_MESSAGE(e.path(), fileEquals(a.path()), "expected " + e.path() +
+      " have the same contents as " + a.path() +
+      ", but goes on after 12 bytes");
+    CHECK_MESSAGE(missing, fileEquals(a.path()), "expected " + missing +
+      " have the same contents as " + a.path() +
+      ", but the files cannot both be read");
+
+    CHECK(fileContains("o w").matches(a.path()));
+    CHECK_MESSAGE(a.path(), fileContains("there"), "expected " + a.path() +
+      " name a file containing there");
+    CHECK_MESSAGE(missing, fileContains("there"), "expected " + missing +
+      " name a file containing there, but it cannot be read");
+
+    CHECK(fileEndsWith("world\n").matches(a.path()));
+    CHECK(fileEndsWith("").matches(d.path()));
+    CHECK(!fileEndsWith("world").matches(a.path()));
+    CHECK(!fileEndsWith("> hello").matches(d.path()));
+    CHECK_MESSAGE(missing, fileEndsWith("!"), "expected " + missing +
+      " name a file ending with !, but it cannot be read");
+
+    // Under a parallel quantifier the failing file is compared on another
+    // thread than the one that reports it.
+    const auto same = fileEquals(a.path());
+    CHECK(!same.matches(d.path()));
+    std::thread([&] { CHECK(!same.matches(c.path())); }).join();
+    writer out;
+    same.describe_mismatch(out, c.path());
+    CHECK(out.view() == ", but first differs at byte 6");
+  }
+
+#if defined(MATCHA_FILES_MMAP)
+  // Streamed files are compared and searched across chunk boundaries.
+  void test_file_chunks()
+  {
+    const std::size_t chunk = matcha::detail::input_file::chunk;
+    std::string text(3 * chunk + 1234, ' ');
+    std::mt19937 rng(24);
+    for (char & ch : text)
+      ch = static_cast<char>('a' + rng() % 26);
+    const temp_file mapped(text);
+
+    {
+      pipe_file streamed(text);
+      CHECK(fileEquals(mapped.path()).matches(streamed.path()));
+    }
+    for (std::size_t at : { chunk - 1, chunk, 2 * chunk + 7,
+                            text.size() - 1 }) {
+      std::string changed = text;
+      changed[at] = '#';
+      pipe_file streamed(changed);
+      const matcha::detail::file_difference d =
+        matcha::detail::compare_files(streamed.path(), mapped.path());
+      CHECK(d.kind == matcha::detail::file_difference::bytes);
+      CHECK(d.offset == at);
+    }
+    {
+      pipe_file shorter(text.substr(0, 2 * chunk));
+      const matcha::detail::file_difference d =
+        matcha::detail::compare_files(shorter.path(), mapped.path());
+      CHECK(d.kind == matcha::detail::file_difference::actual_ends);
+      CHECK(d.offset == 2 * chunk);
+    }
+
+    // Needles straddling a chunk boundary, one longer than a chunk.
+    for (auto [at, n] : { std::pair<std::size_t, std::size_t>{ chunk - 5, 16 },
+                          { 2 * chunk - 1, 2 }, { chunk - 100, chunk + 200 },
+                          { text.size() - 9, 9 } }) {
+      pipe_file streamed(text);
+      CHECK(fileContains(text.substr(at, n)).matches(streamed.path()));
+    }
+    {
+      pipe_file streamed(text);
+      CHECK(!fileContains(std::string("a#b")).matches(streamed.path()));
+    }
+
+    for (std::size_t n : { std::size_t(0), std::size_t(1), std::size_t(5000),
+                           chunk + 3, text.size() }) {
+      pipe_file streamed(text);
+      CHECK(fileEndsWith(text.substr(text.size() - n)).matches(
+        streamed.path()));
+    }
+    {
+      pipe_file streamed(text);
+      CHECK(!fileEndsWith("x" + text).matches(streamed.path()));
+    }
+    {
+      pipe_file streamed(text);
+      CHECK(!fileEndsWith(text.substr(0, 100)).matches(streamed.path()));
+    }
+  }
+#endif
+
+  // Lines
+
+  std::vector<std::string> getlines(const std::string & text)
+  {
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line); )
+      lines.push_back(line);
+    return lines;
+  }
+
+  template<class Source>
+  std::vector<std::string> read_lines(const Source & source)
+  {
+    std::vector<std::string> lines;
+    matcha::detail::each_line(source, [&](std::string_view line) {
+      lines.emplace_back(line);
+      return true;
+    });
+    return lines;
+  }
+
+  // Lines are split as std::getline does, from every kind of source,
+  // including lines that straddle reads or outgrow the buffer.
+  void test_line_splitting()
+  {
+    const std::size_t chunk = matcha::detail::input_file::chunk;
+    std::mt19937 rng(25);
+
+    for (int i = 0; i < 60; ++i) {
+      std::string text;
+      for (int k = 0, n = static_cast<int>(rng() % 40); k < n; ++k) {
+        const std::size_t length = rng() % 5 == 0 ? rng() % (3 * chunk)
+                                                  : rng() % 12;
+        text.append(length, static_cast<char>('a' + k % 26));
+        if (rng() % 8 != 0)
+          text += '\n';
+      }
+      const std::vector<std::string> expected = getlines(text);
+
+      std::istringstream stream(text);
+      CHECK(read_lines(stream) == expected);
+
+      const temp_file mapped(text);
+      CHECK(read_lines(mapped.path()) == expected);
+#if defined(MATCHA_FILES_MMAP)
+      const pipe_file streamed(text);
+      CHECK(read_lines(streamed.descriptor()) == expected);
+#endif
+    }
+  }
+
+  void test_line_matchers()
+  {
+    const std::string log =
+      "INFO start\nINFO step 1\nERROR boom\nINFO step 2\nINFO done";
+
+    {
+      std::istringstream in(log);
+      CHECK_MESSAGE(in, everyLine(startWith("INFO")), "expected [stream] "
+        "every line start with INFO, but line 3 was ERROR boom");
+    }
+    {
+      std::istringstream in(log);
+      CHECK(containsLine(startWith("ERROR")).matches(in));
+    }
+    {
+      std::istringstream in(log);
+      CHECK_MESSAGE(in, containsLine("INFO step 3"), "expected [stream] "
+        "contain the line INFO step 3, but has no such line among its 5 "
+        "lines");
+    }
+    {
+      std::istringstream in(log + "\n");
+      CHECK_MESSAGE(in, lineCount(equal(4u)), "expected [stream] have a "
+        "line count equal 4, but has 5 lines");
+    }
+
+    std::istringstream empty("");
+    CHECK(lineCount(equal(0u)).matches(empty));
+
+    // Streams cannot be read again, so only their own scan is reported.
+    {
+      std::istringstream in(log), other(log);
+      const auto every = everyLine(startWith("INFO"));
+      CHECK(!every.matches(in));
+      writer out;
+      every.describe_mismatch(out, other);
+      CHECK(out.view().empty());
+    }
+
+    // Files named by path are read again for the message, whichever
+    // thread scanned them.
+    {
+      const temp_file two("a\nb\n"), three("a\nb\nc\n");
+      const auto count = lineCount(equal(2u));
+      CHECK(count.matches(two.path()));
+      std::thread([&] { CHECK(!count.matches(three.path())); }).join();
+      writer out;
+      count.describe_mismatch(out, three.path());
+      CHECK(out.view() == ", but has 3 lines");
+    }
+
+    std::ifstream unopened("/nonexistent/matcha_test");
+    CHECK_MESSAGE(unopened, everyLine(startWith("x")),
+      "expected [stream] every line start with x, but it cannot be read");
+    CHECK_MESSAGE(std::string("/nonexistent/matcha_test"),
+      lineCount(equal(0u)), "expected /nonexistent/matcha_test have a line "
+      "count equal 0, but it cannot be read");
+
+#if defined(MATCHA_FILES_MMAP)
+    // Reading stops at the decisive line, with the rest of the pipe
+    // unread.
+    std::string lines;
+    for (int i = 0; i < 100000; ++i)
+      lines += "line " + std::to_string(i) + "\n";
+    const pipe_file streamed(lines);
+    CHECK(containsLine("line 5").matches(streamed.descriptor()));
+    CHECK(matcha::detail::last_scan().lines == 6);
+    CHECK(containsLine("line 99999").matches(streamed.descriptor()));
+    CHECK(matcha::detail::last_scan().lines < 99999);
+#endif
+  }
+
+  // Rules
+
+  // Random rules over integer comparisons, each with the function it
+  // should compute.
+  struct rule_generator
+  {
+    std::mt19937 & rng;
+
+    struct expr
+    {
+      std::string text;
+      std::function<bool(int)> f;
+    };
+
+    int below(int n) { return static_cast<int>(rng() % unsigned(n)); }
+
+    expr leaf()
+    {
+      const int k = below(7) - 3;
+      switch (below(3)) {
+        case 0:
+          return { "equal(" + std::to_string(k) + ")",
+            [k](int x) { return x == k; } };
+        case 1:
+          return { "lessThan(" + std::to_string(k) + ")",
+            [k](int x) { return x < k; } };
+        default:
+          return { "greaterThan(" + std::to_string(k) + ")",
+            [k](int x) { return x > k; } };
+      }
+    }
+
+    expr unary(int depth)
+    {
+      if (depth == 0)
+        return leaf();
+
+      switch (below(6)) {
+        case 0: {
+          expr e = unary(depth - 1);
+          return { "not " + e.text, [f = e.f](int x) { return !f(x); } };
+        }
+        case 1: {
+          expr e = disjunction(depth - 1);
+          return { "(" + e.text + ")", e.f };
+        }
+        case 2: {
+          expr e = disjunction(depth - 1);
+          return { "to(" + e.text + ")", e.f };
+        }
+        case 3: {
+          expr a = disjunction(depth - 1), b = disjunction(depth - 1);
+          return { "anyOf(" + a.text + ", " + b.text + ")",
+            [f = a.f, g = b.f](int x) { return f(x) || g(x); } };
+        }
+        default:
+          return leaf();
+      }
+    }
+
+    expr conjunction(int depth)
+    {
+      expr e = unary(depth);
+      while (below(3) == 0) {
+        expr next = unary(depth);
+        e = { e.text + (below(2) ? " and " : " && ") + next.text,
+          [f = e.f, g = next.f](int x) { return f(x) && g(x); } };
+      }
+      return e;
+    }
+
+    expr disjunction(int depth)
+    {
+      expr e = conjunction(depth);
+      while (below(3) == 0) {
+        expr next = conjunction(depth);
+        e = { e.text + (below(2) ? " or " : " || ") + next.text,
+          [f = e.f, g = next.f](int x) { return f(x) || g(x); } };
+      }
+      return e;
+    }
+  };
+
+  // Short-circuit jumps are threaded through nested and/or, so random
+  // nestings check that every jump still lands where the tree says.
+  void test_rule_random()
+  {
+    std::mt19937 rng(17);
+    rule_generator generate{rng};
+
+    for (int i = 0; i < 2000; ++i) {
+      const rule_generator::expr e = generate.disjunction(3);
+      const matcha::rule r(e.text);
+
+      for (int x = -4; x <= 4; ++x) {
+        if (r.matches(x) != e.f(x)) {
+          std::printf("  rule \"%s\", actual %d\n", e.text.c_str(), x);
+          CHECK(r.matches(x) == e.f(x));
+        }
+      }
+    }
+  }
+
+  void test_rule_parsing()
+  {
+    const matcha::rule r(
+      "not(endWith(\"foo\")) and anyOf(equal(3), equal(5))");
+    CHECK(r.matches(5));
+    CHECK(r.matches(3));
+    CHECK(!r.matches(4));
+    CHECK(!r.matches("foo"));
+
+    CHECK(matcha::rule("equals(\"a\") || startsWith(\"b\")").matches("bc"));
+    CHECK(matcha::rule("!null() && !equal(false)").matches(true));
+    CHECK(matcha::rule("null()").matches(nullptr));
+    CHECK(matcha::rule("oneOf(1, 2.5, \"x\")").matches(2.5));
+    CHECK(matcha::rule("oneOf(1, 2.5, \"x\")").matches("x"));
+    CHECK(!matcha::rule("oneOf(1, 2.5, \"x\")").matches(2));
+    CHECK(matcha::rule("matchRegex(\"a+b\")").matches("aaab"));
+    CHECK(matcha::rule("containSubstring(\"ell\")").matches("hello"));
+    CHECK(matcha::rule("  to ( be ( lessThan ( 0 ) ) ) ").matches(-1));
+
+    // and binds tighter than or.
+    const matcha::rule precedence("equal(1) or equal(2) and equal(3)");
+    CHECK(precedence.matches(1));
+    CHECK(!precedence.matches(2));
+
+    CHECK(matcha::rule(std::string(255, '!') + "equal(1)").matches(2));
+    CHECK(matcha::rule(std::string(200, '(') + "equal(1)" +
+      std::string(200, ')')).matches(1));
+
+    // Copies share the program.
+    const matcha::rule copy = r;
+    CHECK(copy.matches(5));
+    CHECK(copy.source() == r.source());
+  }
+
+  // True if building a rule from source fails with a rule: message.
+  bool rule_rejects(const std::string & source)
+  {
+    try {
+      matcha::rule r(source);
+    } catch (const std::invalid_argument & e) {
+      return std::strncmp(e.what(), "rule: ", 6) == 0;
+    }
+    return false;
+  }
+
+  void test_rule_errors()
+  {
+    CHECK(rule_rejects(""));
+    CHECK(rule_rejects("equal(1"));
+    CHECK(rule_rejects("equal(1))"));
+    CHECK(rule_rejects("equal(1) and"));
+    CHECK(rule_rejects("frobnicate(1)"));
+    CHECK(rule_rejects("equal(\"open)"));
+    CHECK(rule_rejects("oneOf()"));
+    CHECK(rule_rejects("startWith(1)"));
+
+    // Nesting fails with an exception rather than the stack.
+    std::string nots;
+    for (int i = 0; i < 100000; ++i)
+      nots += "not ";
+    CHECK(rule_rejects(nots + "equal(1)"));
+    CHECK(rule_rejects(std::string(100000, '!') + "equal(1)"));
+    CHECK(rule_rejects(std::string(100000, '(') + "equal(1)" +
+      std::string(100000, ')')));
+
+    std::string wrapped = "equal(1)";
+    for (int i = 0; i < 1000; ++i)
+      wrapped = "to(" + wrapped + ")";
+    CHECK(rule_rejects(wrapped));
+  }
+
+  void test_rule_descriptions()
+  {
+    const auto described = [](const char * source) {
+      return matcha::rule(source).description();
+    };
+
+    CHECK(described("equal(1) or equal(2)") == "equal 1 or equal 2");
+    CHECK(described("to(be(anyOf(equal(3), equal(5))))") ==
+      "to be any of equal 3 or equal 5");
+    CHECK(described("not (equal(1) or equal(2)) and greaterThan(0)") ==
+      "not (equal 1 or equal 2) and greater than 0");
+    CHECK(described("not equal(1) or equal(2)") ==
+      "not equal 1 or equal 2");
+    CHECK(described("(equal(1) or equal(2)) and (equal(3) or equal(4))") ==
+      "(equal 1 or equal 2) and (equal 3 or equal 4)");
+    CHECK(described("equal(1) and equal(2) or equal(3)") ==
+      "(equal 1 and equal 2) or equal 3");
+    CHECK(described("anyOf(equal(1) and equal(2), equal(3))") ==
+      "any of (equal 1 and equal 2) or equal 3");
+    CHECK(described("to(equal(1) or equal(2)) and greaterThan(0)") ==
+      "to (equal 1 or equal 2) and greater than 0");
+
+    CHECK_MESSAGE(4, satisfies("to(be(anyOf(equal(3), equal(5))))"),
+      "expected 4 to be any of equal 3 or equal 5");
+  }
+
+
+  struct test
+  {
+    const char * name;
+    void (*run)();
+  };
+
+  const test tests[] = {
+    { "regex_random", test_regex_random },
+    { "regex_byte_classes", test_regex_byte_classes },
+    { "regex_anchors", test_regex_anchors },
+    { "regex_cache_overflow", test_regex_cache_overflow },
+    { "regex_threads", test_regex_threads },
+    { "regex_errors", test_regex_errors },
+    { "matches_all", test_matches_all },
+    { "thread_pool_chunks", test_thread_pool_chunks },
+    { "thread_pool_nesting_and_errors", test_thread_pool_nesting_and_errors },
+    { "find_item", test_find_item },
+    { "async_reporter_order", test_async_reporter_order },
+    { "async_reporter_flush", test_async_reporter_flush },
+    { "edit_script", test_edit_script },
+    { "edit_script_limits", test_edit_script_limits },
+    { "unordered_temporaries", test_unordered_temporaries },
+    { "file_matchers", test_file_matchers },
+#if defined(MATCHA_FILES_MMAP)
+    { "file_chunks", test_file_chunks },
+#endif
+    { "line_splitting", test_line_splitting },
+    { "line_matchers", test_line_matchers },
+    { "rule_random", test_rule_random },
+    { "rule_parsing", test_rule_parsing },
+    { "rule_errors", test_rule_errors },
+    { "rule_descriptions", test_rule_descriptions },
+  };
+
+}; // end anonymous namespace
+
+int main(int argc, char ** argv)
+{
+#if defined(SIGPIPE)
+  // Pipes are closed by their reader before their writer has finished.
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+  const char * filter = "";
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--filter=", 9) == 0)
+      filter = argv[i] + 9;
+  }
+
+  int run = 0;
+  for (const test & t : tests) {
+    if (std::strstr(t.name, filter) == nullptr)
+      continue;
+    const int before = failures;
+    t.run();
+    std::printf("%s %s\n", failures == before ? "ok  " : "FAIL", t.name);
+    ++run;
+  }
+
+  std::printf("%d tests, %d failed checks\n", run, failures);
+  return failures == 0 ? 0 : 1;
+}
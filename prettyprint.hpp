@@ -11,11 +11,18 @@
 #ifndef H_PRETTY_PRINT
 #define H_PRETTY_PRINT
 
+#include <algorithm>
+#include <charconv>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iterator>
 #include <memory>
 #include <ostream>
 #include <set>
+#include <streambuf>
+#include <string>
+#include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <unordered_set>
@@ -71,6 +78,223 @@ namespace pretty_print
     }  // namespace detail
 
 
+    // How much of a value the printers below write into a writer. Containers
+    // longer than max_elements print a head and a tail window with "..."
+    // between them, plus, for the outermost random-access container, a
+    // window around the element at focus. Containers, pairs and tuples
+    // nested deeper than max_depth print as "[...]". Each value printed at
+    // the top level gets max_bytes, past which further elements and string
+    // contents are cut short with "...". Only the windows are visited, so
+    // the cost of printing is bounded for random-access containers whatever
+    // their size.
+
+    struct print_limits
+    {
+        static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+        std::size_t max_elements = none;
+        std::size_t max_depth = none;
+        std::size_t max_bytes = none;
+        std::size_t focus = none;
+    };
+
+
+    // Character sink targeted by the printers. Output goes into a growable
+    // buffer with inline storage, into a fixed caller-supplied buffer (excess
+    // output is dropped and truncated() is set), or through a flush function
+    // whenever the inline buffer fills up.
+    // Usage: "pretty_print::writer w; w << container; w.view();"
+
+    class writer
+    {
+    public:
+        using flush_function = void (*)(void * context, const char * data, std::size_t size);
+
+        writer() noexcept
+        : data_(inline_), capacity_(sizeof inline_)
+        { }
+
+        writer(char * buffer, std::size_t capacity) noexcept
+        : data_(buffer), capacity_(capacity), fixed_(true)
+        { }
+
+        writer(flush_function flush, void * context) noexcept
+        : data_(inline_), capacity_(sizeof inline_), flush_(flush), context_(context)
+        { }
+
+        // Adapter writing through to an std::ostream in buffer-sized blocks.
+        explicit writer(std::ostream & stream) noexcept
+        : writer(&flush_ostream, &stream)
+        { }
+
+        writer(const writer &) = delete;
+        writer & operator=(const writer &) = delete;
+
+        ~writer()
+        {
+            flush();
+            if (data_ != inline_ && !fixed_)
+                delete[] data_;
+        }
+
+        void write(const char * s, std::size_t n)
+        {
+            if (n <= capacity_ - size_)
+            {
+                std::memcpy(data_ + size_, s, n);
+                size_ += n;
+            }
+            else
+                overflow(s, n);
+        }
+
+        void put(char c)
+        {
+            if (size_ < capacity_)
+                data_[size_++] = c;
+            else
+                overflow(&c, 1);
+        }
+
+        void flush()
+        {
+            if (flush_ != nullptr && size_ != 0)
+            {
+                flush_(context_, data_, size_);
+                flushed_ += size_;
+                size_ = 0;
+            }
+        }
+
+        // Limits applied by the printers from now on.
+        void limit(const print_limits & limits) noexcept { limits_ = limits; }
+
+        const print_limits & limits() const noexcept { return limits_; }
+
+        // Bytes written so far, including those already flushed.
+        std::size_t written() const noexcept { return flushed_ + size_; }
+
+        // Bytes the value being printed can still take under
+        // limits().max_bytes.
+        std::size_t budget() const noexcept
+        {
+            if (depth_ == 0 || limits_.max_bytes == print_limits::none)
+                return limits_.max_bytes;
+            std::size_t used = written() - value_start_;
+            return used < limits_.max_bytes ? limits_.max_bytes - used : 0;
+        }
+
+        // Nesting of the containers being printed. enter() returns false,
+        // without entering, past limits().max_depth.
+        std::size_t depth() const noexcept { return depth_; }
+
+        bool enter() noexcept
+        {
+            if (depth_ >= limits_.max_depth)
+                return false;
+            if (depth_++ == 0)
+                value_start_ = written();
+            return true;
+        }
+
+        void leave() noexcept { --depth_; }
+
+        void clear() noexcept { size_ = 0; truncated_ = false; }
+
+        const char * data() const noexcept { return data_; }
+        std::size_t size() const noexcept { return size_; }
+        bool truncated() const noexcept { return truncated_; }
+        std::string_view view() const noexcept { return std::string_view(data_, size_); }
+        std::string str() const { return std::string(data_, size_); }
+
+    private:
+        static void flush_ostream(void * context, const char * data, std::size_t size)
+        {
+            static_cast<std::ostream *>(context)->write(data, static_cast<std::streamsize>(size));
+        }
+
+        void overflow(const char * s, std::size_t n)
+        {
+            if (flush_ != nullptr)
+            {
+                flush();
+                if (n < capacity_)
+                {
+                    std::memcpy(data_, s, n);
+                    size_ = n;
+                }
+                else
+                {
+                    flush_(context_, s, n);
+                    flushed_ += n;
+                }
+            }
+            else if (fixed_)
+            {
+                std::size_t room = capacity_ - size_;
+                std::memcpy(data_ + size_, s, room);
+                size_ = capacity_;
+                truncated_ = true;
+            }
+            else
+            {
+                std::size_t capacity = capacity_ * 2;
+                while (capacity - size_ < n)
+                    capacity *= 2;
+
+                char * data = new char[capacity];
+                std::memcpy(data, data_, size_);
+                if (data_ != inline_)
+                    delete[] data_;
+                data_ = data;
+                capacity_ = capacity;
+
+                std::memcpy(data_ + size_, s, n);
+                size_ += n;
+            }
+        }
+
+        char * data_;
+        std::size_t size_ = 0;
+        std::size_t capacity_;
+        std::size_t flushed_ = 0;
+        bool fixed_ = false;
+        bool truncated_ = false;
+        flush_function flush_ = nullptr;
+        void * context_ = nullptr;
+        print_limits limits_;
+        std::size_t value_start_ = 0;
+        std::size_t depth_ = 0;
+        char inline_[256];
+    };
+
+    // std::streambuf appending to a writer, so that types which only provide
+    // operator<< can still be formatted into one.
+
+    class writer_streambuf : public std::streambuf
+    {
+    public:
+        explicit writer_streambuf(writer & w) : w_(w) { }
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                w_.put(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char * s, std::streamsize n) override
+        {
+            w_.write(s, static_cast<std::size_t>(n));
+            return n;
+        }
+
+    private:
+        writer & w_;
+    };
+
+
     // Holds the delimiter values for a specific character type
 
     template <typename TChar>
@@ -109,7 +333,8 @@ namespace pretty_print
         template <typename U>
         struct printer
         {
-            static void print_body(const U & c, ostream_type & stream)
+            template <typename Stream>
+            static void print_body(const U & c, Stream & stream)
             {
                 using std::begin;
                 using std::end;
@@ -117,7 +342,11 @@ namespace pretty_print
                 auto it = begin(c);
                 const auto the_end = end(c);
 
-                if (it != the_end)
+                if constexpr (std::is_same<Stream, writer>::value)
+                {
+                    print_windows(it, the_end, stream);
+                }
+                else if (it != the_end)
                 {
                     for ( ; ; )
                     {
@@ -130,14 +359,156 @@ namespace pretty_print
                     }
                 }
             }
+
+        private:
+            // Writes elements and "..." gaps with delimiters between them,
+            // and stops with a last "..." once the byte budget is spent.
+            struct sequence
+            {
+                writer & w;
+                bool first = true;
+                bool done = false;
+
+                void separate()
+                {
+                    if (!first && delimiters_type::values.delimiter != NULL)
+                        w << delimiters_type::values.delimiter;
+                    first = false;
+                }
+
+                template <typename E>
+                void element(const E & e)
+                {
+                    if (done)
+                        return;
+                    separate();
+                    if (w.budget() == 0)
+                    {
+                        w.write("...", 3);
+                        done = true;
+                    }
+                    else
+                        w << e;
+                }
+
+                void gap()
+                {
+                    if (done)
+                        return;
+                    separate();
+                    w.write("...", 3);
+                }
+            };
+
+            template <typename Iter, typename Sentinel>
+            static void print_windows(Iter first, Sentinel last, writer & w)
+            {
+                using category = typename std::iterator_traits<Iter>::iterator_category;
+
+                const std::size_t max = w.limits().max_elements;
+                sequence out{w};
+
+                if constexpr (std::is_same<Iter, Sentinel>::value &&
+                              std::is_base_of<std::random_access_iterator_tag, category>::value)
+                {
+                    const auto n = static_cast<std::size_t>(last - first);
+                    if (n <= max)
+                    {
+                        for ( ; first != last && !out.done; ++first)
+                            out.element(*first);
+                        return;
+                    }
+
+                    // Head, focus and tail windows as [begin, end) index
+                    // ranges, in order; overlapping ones are merged below.
+                    std::size_t windows[3][2];
+                    std::size_t count = 0;
+                    const std::size_t focus = w.depth() == 1 ? w.limits().focus : print_limits::none;
+
+                    if (focus < n && max >= 3)
+                    {
+                        const std::size_t edge = max / 4;
+                        const std::size_t around = max - 2 * edge;
+                        std::size_t from = focus - std::min(focus, around / 2);
+                        from = std::min(from, n - around);
+
+                        windows[count][0] = 0;            windows[count++][1] = edge;
+                        windows[count][0] = from;         windows[count++][1] = from + around;
+                        windows[count][0] = n - edge;     windows[count++][1] = n;
+                    }
+                    else
+                    {
+                        windows[count][0] = 0;            windows[count++][1] = max - max / 2;
+                        windows[count][0] = n - max / 2;  windows[count++][1] = n;
+                    }
+
+                    std::size_t next = 0;
+                    for (std::size_t k = 0; k < count; ++k)
+                    {
+                        std::size_t from = std::max(windows[k][0], next);
+                        if (from >= windows[k][1])
+                            continue;
+                        if (from > next)
+                            out.gap();
+                        for (std::size_t i = from; i < windows[k][1]; ++i)
+                            out.element(first[static_cast<std::ptrdiff_t>(i)]);
+                        next = windows[k][1];
+                    }
+                    if (next < n)
+                        out.gap();
+                }
+                else if constexpr (std::is_same<Iter, Sentinel>::value &&
+                                   std::is_base_of<std::bidirectional_iterator_tag, category>::value)
+                {
+                    // Finding the size would walk the container, so the
+                    // head is printed first and the tail found by walking
+                    // back from the end.
+                    const std::size_t head = max - max / 2;
+                    std::size_t i = 0;
+                    for ( ; first != last && i < head; ++first, ++i)
+                        out.element(*first);
+
+                    Iter tail = last;
+                    std::size_t behind = 0;
+                    for ( ; tail != first && behind < max / 2; ++behind)
+                        --tail;
+
+                    if (tail != first)
+                        out.gap();
+                    for ( ; tail != last; ++tail)
+                        out.element(*tail);
+                }
+                else
+                {
+                    std::size_t i = 0;
+                    for ( ; first != last && i < max; ++first, ++i)
+                        out.element(*first);
+                    if (first != last)
+                        out.gap();
+                }
+            }
         };
 
         print_container_helper(const T & container)
         : container_(container)
         { }
 
-        inline void operator()(ostream_type & stream) const
+        template <typename Stream>
+        inline void operator()(Stream & stream) const
         {
+            if constexpr (std::is_same<Stream, writer>::value)
+            {
+                if (!stream.enter())
+                {
+                    if (delimiters_type::values.prefix != NULL)
+                        stream << delimiters_type::values.prefix;
+                    stream.write("...", 3);
+                    if (delimiters_type::values.postfix != NULL)
+                        stream << delimiters_type::values.postfix;
+                    return;
+                }
+            }
+
             if (delimiters_type::values.prefix != NULL)
                 stream << delimiters_type::values.prefix;
 
@@ -145,6 +516,9 @@ namespace pretty_print
 
             if (delimiters_type::values.postfix != NULL)
                 stream << delimiters_type::values.postfix;
+
+            if constexpr (std::is_same<Stream, writer>::value)
+                stream.leave();
         }
 
     private:
@@ -157,9 +531,8 @@ namespace pretty_print
     template <typename T1, typename T2>
     struct print_container_helper<T, TChar, TCharTraits, TDelimiters>::printer<std::pair<T1, T2>>
     {
-        using ostream_type = print_container_helper<T, TChar, TCharTraits, TDelimiters>::ostream_type;
-
-        static void print_body(const std::pair<T1, T2> & c, ostream_type & stream)
+        template <typename Stream>
+        static void print_body(const std::pair<T1, T2> & c, Stream & stream)
         {
             stream << c.first;
             if (print_container_helper<T, TChar, TCharTraits, TDelimiters>::delimiters_type::values.delimiter != NULL)
@@ -174,29 +547,31 @@ namespace pretty_print
     template <typename ...Args>
     struct print_container_helper<T, TChar, TCharTraits, TDelimiters>::printer<std::tuple<Args...>>
     {
-        using ostream_type = print_container_helper<T, TChar, TCharTraits, TDelimiters>::ostream_type;
         using element_type = std::tuple<Args...>;
 
         template <std::size_t I> struct Int { };
 
-        static void print_body(const element_type & c, ostream_type & stream)
+        template <typename Stream>
+        static void print_body(const element_type & c, Stream & stream)
         {
             tuple_print(c, stream, Int<0>());
         }
 
-        static void tuple_print(const element_type &, ostream_type &, Int<sizeof...(Args)>)
+        template <typename Stream>
+        static void tuple_print(const element_type &, Stream &, Int<sizeof...(Args)>)
         {
         }
 
-        static void tuple_print(const element_type & c, ostream_type & stream,
+        template <typename Stream>
+        static void tuple_print(const element_type & c, Stream & stream,
                                 typename std::conditional<sizeof...(Args) != 0, Int<0>, std::nullptr_t>::type)
         {
             stream << std::get<0>(c);
             tuple_print(c, stream, Int<1>());
         }
 
-        template <std::size_t N>
-        static void tuple_print(const element_type & c, ostream_type & stream, Int<N>)
+        template <typename Stream, std::size_t N>
+        static void tuple_print(const element_type & c, Stream & stream, Int<N>)
         {
             if (print_container_helper<T, TChar, TCharTraits, TDelimiters>::delimiters_type::values.delimiter != NULL)
                 stream << print_container_helper<T, TChar, TCharTraits, TDelimiters>::delimiters_type::values.delimiter;
@@ -218,6 +593,19 @@ namespace pretty_print
         return stream;
     }
 
+    // Narrow streams are only an adapter: the container is formatted into a
+    // writer, which hands the result to the stream in blocks.
+
+    template<typename T, typename TDelimiters>
+    inline std::ostream & operator<<(
+        std::ostream & stream,
+        const print_container_helper<T, char, std::char_traits<char>, TDelimiters> & helper)
+    {
+        writer w(stream);
+        helper(w);
+        return stream;
+    }
+
 
     // Basic is_container template; specialize to derive from std::true_type for all desired container types
 
@@ -243,6 +631,131 @@ namespace pretty_print
     struct is_container<std::tuple<Args...>> : std::true_type { };
 
 
+    // Formatting into a writer. Arithmetic values go through std::to_chars and
+    // strings are copied up to the writer's byte budget (C strings and char
+    // arrays, usually literals, in full); specialize formatter<T> for other
+    // types, otherwise their operator<< is used through a writer_streambuf.
+    // Function objects print as [callable] and types without operator<< as
+    // [object].
+
+    namespace detail
+    {
+        template <typename T>
+        struct is_string : std::false_type { };
+
+        template <typename TCharTraits, typename TAllocator>
+        struct is_string<std::basic_string<char, TCharTraits, TAllocator>> : std::true_type { };
+
+        template <typename TCharTraits>
+        struct is_string<std::basic_string_view<char, TCharTraits>> : std::true_type { };
+
+        template <typename T, typename = void>
+        struct is_streamable : std::false_type { };
+
+        template <typename T>
+        struct is_streamable<T, std::void_t<decltype(std::declval<std::ostream &>() << std::declval<const T &>())>>
+        : std::true_type { };
+
+        template <typename T>
+        void write_chars(writer & w, T value)
+        {
+            char buffer[64];
+            auto result = std::to_chars(buffer, buffer + sizeof buffer, value);
+            w.write(buffer, static_cast<std::size_t>(result.ptr - buffer));
+        }
+
+        // Writes s, cut short with "..." past the writer's byte budget.
+        inline void write_bounded(writer & w, const char * s, std::size_t n)
+        {
+            const std::size_t budget = w.budget();
+            if (n <= budget)
+                w.write(s, n);
+            else
+            {
+                w.write(s, budget);
+                w.write("...", 3);
+            }
+        }
+
+        inline void write_cstring(writer & w, const char * s)
+        {
+            if (s == nullptr)
+                w.write("(null)", 6);
+            else
+                w.write(s, std::strlen(s));
+        }
+    }
+
+    template <typename T, typename Enable = void>
+    struct formatter
+    {
+        static void format(writer & w, const T & value)
+        {
+            using detail::write_chars;
+
+            if constexpr (std::is_same<T, bool>::value)
+                value ? w.write("true", 4) : w.write("false", 5);
+            else if constexpr (std::is_same<T, char>::value
+                            || std::is_same<T, signed char>::value
+                            || std::is_same<T, unsigned char>::value)
+                w.put(static_cast<char>(value));
+            else if constexpr (std::is_arithmetic<T>::value)
+                write_chars(w, value);
+            else if constexpr (std::is_same<T, std::nullptr_t>::value)
+                w.write("nullptr", 7);
+            else if constexpr (std::is_same<T, const char *>::value || std::is_same<T, char *>::value)
+                detail::write_cstring(w, value);
+            else if constexpr (std::is_pointer<T>::value)
+            {
+                w.write("0x", 2);
+                char buffer[2 * sizeof(void *)];
+                auto result = std::to_chars(buffer, buffer + sizeof buffer,
+                                            reinterpret_cast<std::uintptr_t>(value), 16);
+                w.write(buffer, static_cast<std::size_t>(result.ptr - buffer));
+            }
+            else if constexpr (detail::is_string<T>::value)
+                detail::write_bounded(w, value.data(), value.size());
+            else if constexpr (is_container<T>::value)
+            {
+                print_container_helper<T> helper(value);
+                helper(w);
+            }
+            else if constexpr (std::is_class<T>::value && std::is_invocable<const T &>::value)
+                w.write("[callable]", 10);
+            else if constexpr (detail::is_streamable<T>::value)
+            {
+                writer_streambuf buffer(w);
+                std::ostream stream(&buffer);
+                stream << value;
+            }
+            else
+                w.write("[object]", 8);
+        }
+    };
+
+    template <std::size_t N>
+    struct formatter<char[N]>
+    {
+        static void format(writer & w, const char (&value)[N])
+        {
+            const char * end = static_cast<const char *>(std::memchr(value, '\0', N));
+            w.write(value, end != nullptr ? static_cast<std::size_t>(end - value) : N);
+        }
+    };
+
+    template <typename T>
+    inline writer & operator<<(writer & w, const T & value)
+    {
+        formatter<T>::format(w, value);
+        return w;
+    }
+
+    inline std::ostream & operator<<(std::ostream & stream, const writer & w)
+    {
+        return stream.write(w.data(), static_cast<std::streamsize>(w.size()));
+    }
+
+
     // Default delimiters
 
     template <typename T> struct delimiters<T, char> { static const delimiters_values<char> values; };